@@ -0,0 +1,89 @@
+from __future__ import print_function
+
+# Generate src/cem_corpus.h, the sample stream cem compresses when built
+# with SAMPLE_SOURCE=1.
+#
+# usage: python cem_corpus.py synth [len] > ../../src/cem_corpus.h
+#        python cem_corpus.py file samples.txt > ../../src/cem_corpus.h
+#
+#   synth     a 12-bit ADC trace: slow drift, a daily-like cycle, a few
+#             level steps and a couple of LSBs of noise (fixed seed)
+#   file      one sample per line (decimal or 0x hex), e.g. a capture from
+#             a real sensor; '#' starts a comment
+#
+# The length is cut to a power of 2 so that the device can wrap its index
+# with a mask.
+
+import sys
+import re
+import math
+import random
+
+SAMPLE_MASK = 0xffff # sample_t is 16 bits
+
+def synth(length):
+    rnd = random.Random(430)
+    samples = []
+    drift = 0.0
+    level = 0.0
+    for t in range(length):
+        drift = 0.98 * drift + rnd.gauss(0, 2.0)
+        if rnd.random() < 0.01:
+            level = rnd.choice([0.0, 180.0, -120.0, 350.0])
+        v = 2048 + 400 * math.sin(2 * math.pi * t / 700.0) + drift + level
+        v += rnd.gauss(0, 1.5)
+        samples.append(max(0, min(4095, int(round(v)))))
+    return samples
+
+def from_file(path):
+    samples = []
+    for line in open(path):
+        line = line.split("#")[0].strip()
+        if line:
+            samples.append(int(line, 0) & SAMPLE_MASK)
+    return samples
+
+def read_corpus(header):
+    """Samples from a generated cem_corpus.h"""
+    text = open(header).read()
+    body = text[text.index("CEM_CORPUS_INIT"):]
+    return [int(v, 16) for v in re.findall(r"0x([0-9a-fA-F]+),", body)]
+
+def letters(samples):
+    """The byte stream cem letterizes the samples into, low byte first"""
+    out = []
+    for s in samples:
+        out += [s & 0xff, s >> 8]
+    return out
+
+def main():
+    if len(sys.argv) < 2 or sys.argv[1] not in ("synth", "file") or \
+            (sys.argv[1] == "file" and len(sys.argv) < 3):
+        raise SystemExit("usage: cem_corpus.py synth [len] | " +
+                "cem_corpus.py file samples.txt")
+    if sys.argv[1] == "synth":
+        length = int(sys.argv[2]) if len(sys.argv) > 2 else 1024
+        samples = synth(length)
+        source = "synthetic 12-bit sensor trace"
+    else:
+        samples = from_file(sys.argv[2])
+        source = sys.argv[2]
+
+    length = 1
+    while length * 2 <= len(samples):
+        length *= 2
+    if length != len(samples):
+        sys.stderr.write("cem_corpus: using the first %u of %u samples\n" %
+                (length, len(samples)))
+    samples = samples[:length]
+
+    print("// Generated by ext/python_dissembler/cem_corpus.py -- do not edit.")
+    print("// source: %s" % source)
+    print("#define CEM_CORPUS_LEN %u" % length)
+    print("#define CEM_CORPUS_INIT { \\")
+    for i in range(0, length, 8):
+        print("\t" + " ".join("0x%04x," % s for s in samples[i:i + 8]) + " \\")
+    print("}")
+
+if __name__ == "__main__":
+    main()
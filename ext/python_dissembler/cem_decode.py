@@ -0,0 +1,125 @@
+from __future__ import print_function
+
+# Decode the bit-packed LZW blocks that cem prints with VERBOSE=1.
+#
+# usage: python cem_decode.py console.log [dict_size [corpus.h]]
+#
+# Every block is unpacked with the same code widths the encoder used and
+# LZW-decoded back into letters. A block round-trips when the number of
+# decoded letters matches the sample count the device reported (which also
+# counts the letter that was pending when the block closed, and which
+# starts the next block).
+#
+# Given the cem_corpus.h the device was built with (SAMPLE_SOURCE=1), the
+# decoded stream must also equal the corpus bytes from a fresh start on.
+
+import sys
+import re
+
+from cem_corpus import read_corpus, letters as corpus_letters
+
+NUM_LETTERS = 256
+LETTER_SIZE_BITS = 8
+
+def code_width(node_count):
+    width = LETTER_SIZE_BITS
+    while (1 << width) < node_count:
+        width += 1
+    return width
+
+def unpack(words, bit_count, dict_size):
+    stream = 0
+    for i, w in enumerate(words):
+        stream |= w << (16 * i)
+
+    codes = []
+    pos = 0
+    while pos < bit_count:
+        # The encoder adds one node after every code until the table is full
+        width = code_width(min(NUM_LETTERS + len(codes), dict_size))
+        codes.append((stream >> pos) & ((1 << width) - 1))
+        pos += width
+    return codes
+
+def lzw_decode(codes, dict_size):
+    strings = {}
+    next_code = NUM_LETTERS
+    prev = None
+    out = []
+    for code in codes:
+        if code < NUM_LETTERS:
+            s = [code]
+        elif code in strings:
+            s = strings[code]
+        elif code == next_code and prev is not None:
+            s = prev + [prev[0]] # the KwKwK case
+        else:
+            raise ValueError("bad code %u (next %u)" % (code, next_code))
+        out += s
+        if prev is not None and next_code < dict_size:
+            strings[next_code] = prev + [s[0]]
+            next_code += 1
+        prev = s
+    return out
+
+def blocks(console):
+    """Yield (sample_count, code_count, bit_count, words) per printed block"""
+    rate = None
+    block = None
+    for line in open(console):
+        m = re.search(r"rate: samples/block: (\d+)/(\d+)", line)
+        if m is not None:
+            rate = (int(m.group(1)), int(m.group(2)))
+            continue
+        m = re.search(r"compressed block: (\d+) bits", line)
+        if m is not None:
+            block = (int(m.group(1)), [])
+            continue
+        if block is not None:
+            tokens = line.split()
+            if tokens and all(re.match(r"^[0-9a-fA-F]{4}$", t) for t in tokens):
+                block[1].extend(int(t, 16) for t in tokens)
+            if len(block[1]) >= (block[0] + 15) // 16:
+                yield rate[0], rate[1], block[0], block[1]
+                block = None
+
+def main():
+    if len(sys.argv) < 2:
+        raise SystemExit("usage: cem_decode.py console.log [dict_size]")
+    dict_size = int(sys.argv[2]) if len(sys.argv) > 2 else 512
+    corpus = read_corpus(sys.argv[3]) if len(sys.argv) > 3 else None
+
+    ok = True
+    stream = []
+    bytes_out = 0
+    for n, (samples, count, bits, words) in enumerate(blocks(sys.argv[1])):
+        codes = unpack(words, bits, dict_size)
+        letters = lzw_decode(codes, dict_size)
+        good = len(codes) == count and len(letters) == samples - 1
+        ok = ok and good
+        stream += letters
+        bytes_out += (bits + 7) // 8
+        print("block %u: %u codes, %u bits (%u unpacked), %u letters: %s" %
+                (n, len(codes), bits, count * 16, len(letters),
+                    "ok" if good else "MISMATCH"))
+        print("  " + " ".join("%02x" % l for l in letters[:32]) +
+                (" ..." if len(letters) > 32 else ""))
+    if not stream:
+        raise SystemExit("no blocks in " + sys.argv[1])
+
+    # One letter per byte; the first one is the fixed '0' prefix
+    bytes_in = len(stream) - 1
+    print("total: %u B in, %u B out, ratio %.2f" %
+            (bytes_in, bytes_out, float(bytes_in) / bytes_out))
+
+    if corpus is not None:
+        expect = corpus_letters(corpus)
+        expect *= bytes_in // len(expect) + 1
+        same = stream[1:] == expect[:bytes_in]
+        ok = ok and same
+        print("corpus: %s" % ("match" if same else "MISMATCH"))
+    if not ok:
+        sys.exit(1)
+
+if __name__ == "__main__":
+    main()
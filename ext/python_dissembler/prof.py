@@ -0,0 +1,116 @@
+from __future__ import print_function
+
+# Host side of the PC-sampling profiler (src/prof.h).
+#
+# usage: python prof.py bins mem.src > ../../src/prof_bins.h
+#        python prof.py report mem.src dump
+#
+#   mem.src   objdump -x of the profiled binary (compile.sh writes it here)
+#   dump      prof_hist contents, raw binary or Intel HEX, e.g.
+#             mspdebug tilib "hexout <addr> <size> prof.hex"
+#             (run report without a dump to print addr and size)
+#
+# Both commands must see the same symbol table: regenerate the bins and
+# rebuild whenever the code changes.
+
+import sys
+import re
+import struct
+
+from trace_decode import find_symbol, read_dump
+
+# Must match src/prof.h
+PROF_SHIFT = 4
+PROF_MAP_LEN = 1024
+PROF_NUM_BINS = 256
+
+def functions(mem_src):
+    """Function symbols in .text as a sorted list of (addr, size, name)"""
+    funcs = {}
+    for line in open(mem_src):
+        sym = re.match(r"^(?P<addr>[0-9a-f]+) [lg] +F \.text\t" +
+                r"(?P<size>[0-9a-f]+) (?P<name>\S+)$", line.strip())
+        if sym is None:
+            continue
+        addr = int(sym.group("addr"), 16)
+        size = int(sym.group("size"), 16)
+        # Keep one name per address, preferring the one that has a size
+        if addr not in funcs or funcs[addr][0] == 0:
+            funcs[addr] = (size, sym.group("name"))
+    return [(a, funcs[a][0], funcs[a][1]) for a in sorted(funcs)]
+
+def bins(mem_src):
+    funcs = functions(mem_src)
+    if len(funcs) >= PROF_NUM_BINS:
+        sys.stderr.write("prof: %u functions, only the first %u get a bin\n" %
+                (len(funcs), PROF_NUM_BINS - 1))
+        funcs = funcs[:PROF_NUM_BINS - 1]
+    start = funcs[0][0]
+
+    # Bin of each granule: the last function starting at or before it
+    bin_map = []
+    f = 0
+    for g in range(PROF_MAP_LEN):
+        addr = start + (g << PROF_SHIFT)
+        while f + 1 < len(funcs) and funcs[f + 1][0] <= addr:
+            f += 1
+        end = funcs[f][0] + max(funcs[f][1], 1 << PROF_SHIFT)
+        if f + 1 == len(funcs) and addr >= end:
+            bin_map.append(0)
+        else:
+            bin_map.append(f + 1)
+
+    print("// Generated by ext/python_dissembler/prof.py bins -- do not edit.")
+    for i, (addr, size, name) in enumerate(funcs):
+        print("// bin %3u: %04x %s" % (i + 1, addr, name))
+    print("#define PROF_TEXT_START 0x%04x" % start)
+    print("#define PROF_MAP_INIT { \\")
+    for i in range(0, PROF_MAP_LEN, 16):
+        print("\t" + " ".join("%u," % b for b in bin_map[i:i + 16]) + " \\")
+    print("}")
+
+def report(mem_src, dump_path):
+    base, size = find_symbol(mem_src, "prof_hist")
+    if dump_path is None:
+        print("prof_hist: addr 0x%04x size %u" % (base, size))
+        print("mspdebug tilib \"hexout 0x%04x %u prof.hex\"" % (base, size))
+        return
+
+    dump = read_dump(dump_path, base, size)
+    hist = struct.unpack_from("<%uI" % PROF_NUM_BINS, dump, 0)
+    names = ["(other)"] + [f[2] for f in functions(mem_src)]
+
+    total = sum(hist)
+    if total == 0:
+        print("no samples")
+        return
+
+    # Fold the Ratchet-renamed app functions back to their source names
+    by_func = {}
+    for b, count in enumerate(hist):
+        if count == 0:
+            continue
+        name = names[b] if b < len(names) else "(bin %u)" % b
+        name = re.sub("^_ratchet_", "", name)
+        by_func[name] = by_func.get(name, 0) + count
+
+    print("%u samples" % total)
+    for name in sorted(by_func, key=lambda n: -by_func[n]):
+        print("  %6.2f%% %8u %s" % (100.0 * by_func[name] / total,
+            by_func[name], name))
+
+    runtime = sum(by_func.get(n, 0) for n in ("checkpoint", "restore_regs"))
+    print("ratchet runtime (checkpoint + restore_regs): %.2f%%" %
+            (100.0 * runtime / total))
+
+def main():
+    if len(sys.argv) < 3 or sys.argv[1] not in ("bins", "report"):
+        raise SystemExit("usage: prof.py bins mem.src | " +
+                "prof.py report mem.src [dump]")
+    if sys.argv[1] == "bins":
+        bins(sys.argv[2])
+    else:
+        report(sys.argv[2], sys.argv[3] if len(sys.argv) > 3 else None)
+
+if __name__ == "__main__":
+    main()
@@ -1,3 +1,4 @@
+import os
 import sys
 import fileinput
 import re
@@ -24,6 +25,9 @@ def insertSafeFuncEnd(stackIncrease, regList):
     # return
     print "\tmov.w\tr14, r0"
 
+def atomicError(funcName, msg):
+    sys.exit("ratchet_backend: " + funcName + ": " + msg)
+
 def insertStackProtection():
     # Check if this is the first execution
     print "\tmov.b\t&chkpt_ever_taken, r12"
@@ -46,6 +50,11 @@ def insertStackProtection():
 
 func_start = False
 roi_start = False
+# Inside RATCHET_ATOMIC_BEGIN() .. END() (src/atomic.h) the undo log keeps
+# the region all-or-nothing, so the checkpoints the pass put there go.
+# The region must stay within one function and call no function of the
+# app, whose own checkpoints would split it.
+atomic = False
 
 stack_increase = -1
 regList = []
@@ -61,6 +70,24 @@ for line in fileinput.input(sys.argv[1], inplace=1):
         print line,
     elif func_start:
         isChanged = False
+        if re.search("RATCHET_ATOMIC_BEGIN", line) is not None:
+            if atomic:
+                atomicError(func_name, "nested RATCHET_ATOMIC_BEGIN")
+            atomic = True
+        elif re.search("RATCHET_ATOMIC_END", line) is not None:
+            if not atomic:
+                atomicError(func_name, "RATCHET_ATOMIC_END without BEGIN")
+            atomic = False
+        elif atomic:
+            if re.search(r"\tcall\t#checkpoint$", line) is not None:
+                continue
+            if re.search(r"\tcall\t#_ratchet_", line) is not None:
+                atomicError(func_name, "call in atomic region: " + line.strip())
+            if re.search(r"\tcall\tr[0-9]+", line) is not None:
+                atomicError(func_name, "indirect call in atomic region")
+            if re.match(".Lfunc_end", line) is not None or \
+                    re.search("\tret$", line) is not None:
+                atomicError(func_name, "RATCHET_ATOMIC_BEGIN without END")
         # Optimization. We need to guard 3 things.
         # local stack return, pop, and ret
         # We assume that those all only occurs at the
@@ -123,3 +150,11 @@ for line in fileinput.input(sys.argv[1], inplace=1):
     else:
         print line,
 
+# With CHKPT_COUNT=1 (bld/Makefile), count every checkpoint left in the app
+# in chkpt_counter (src/chkpt.h). The flags are dead at a call.
+if os.environ.get("CHKPT_COUNT", "0") == "1":
+    for line in fileinput.input(sys.argv[1], inplace=1):
+        if re.search(r"\tcall\t#checkpoint$", line) is not None:
+            print "\tadd.w\t#1, &chkpt_counter"
+            print "\tadc.w\t&chkpt_counter+2"
+        print line,
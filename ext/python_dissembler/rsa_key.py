@@ -0,0 +1,103 @@
+from __future__ import print_function
+
+# Generate an RSA key for src/main_rsa.c, as data/key<bits>.txt and, for
+# builds with PRIVATE_KEY=1, data/key<bits>_priv.txt.
+#
+# usage: python rsa_key.py bits [e] > ../../data/key<bits>.txt
+#        python rsa_key.py -p bits [e] > ../../data/key<bits>_priv.txt
+#
+# The public file is the initializer of pubkey_t: the modulus as bytes, LSB
+# first, then the public exponent (default 17; it must fit in 16 bits). The
+# private one is the initializer of privkey_t: d, then p, q, dP, dQ and
+# qInv at half the key length, all LSB first. The modulus has its top bit
+# set, as main_rsa.c's padding requires, and so do p and q, as its
+# Montgomery set-up requires. Keys come from a fixed seed per size, so the
+# two files always match -- and the key is not secret.
+
+import sys
+import random
+
+def is_probable_prime(n, rnd, rounds=40):
+    if n < 2:
+        return False
+    for p in (2, 3, 5, 7, 11, 13, 17, 19, 23, 29, 31, 37):
+        if n % p == 0:
+            return n == p
+    d, s = n - 1, 0
+    while d % 2 == 0:
+        d, s = d // 2, s + 1
+    for _ in range(rounds):
+        x = pow(rnd.randrange(2, n - 1), d, n)
+        if x in (1, n - 1):
+            continue
+        for _ in range(s - 1):
+            x = pow(x, 2, n)
+            if x == n - 1:
+                break
+        else:
+            return False
+    return True
+
+def gen_prime(bits, e, rnd):
+    while True:
+        # Top two bits set, so that the product of two has exactly 2*bits
+        p = rnd.getrandbits(bits) | (3 << (bits - 2)) | 1
+        if (p - 1) % e != 0 and is_probable_prime(p, rnd):
+            return p
+
+def gen_key(bits, e):
+    rnd = random.Random(bits)
+    while True:
+        p = gen_prime(bits // 2, e, rnd)
+        q = gen_prime(bits - bits // 2, e, rnd)
+        n = p * q
+        if p != q and n >> (bits - 1) == 1:
+            return n, p, q
+
+def inverse(a, m):
+    """a^-1 mod m"""
+    r0, r1, s0, s1 = m, a % m, 0, 1
+    while r1:
+        k = r0 // r1
+        r0, r1, s0, s1 = r1, r0 - k * r1, s1, s0 - k * s1
+    if r0 != 1:
+        raise ValueError("not invertible")
+    return s0 % m
+
+def c_bytes(value, length, indent="\t"):
+    data = [(value >> (8 * i)) & 0xff for i in range(length)]
+    lines = []
+    for i in range(0, length, 12):
+        lines.append(indent + ", ".join("0x%02x" % b for b in data[i:i + 12]))
+    return "{\n" + ",\n".join(lines) + "\n}"
+
+def main():
+    args = sys.argv[1:]
+    private = len(args) > 0 and args[0] == "-p"
+    if private:
+        args = args[1:]
+    if len(args) < 1:
+        raise SystemExit("usage: rsa_key.py [-p] bits [e]")
+    bits = int(args[0])
+    e = int(args[1], 0) if len(args) > 1 else 17
+    if bits % 16 != 0 or bits < 32:
+        raise SystemExit("rsa_key: bits must be a multiple of 16, at least 32")
+    if e > 0xffff or e % 2 == 0:
+        raise SystemExit("rsa_key: e must be odd and fit in 16 bits")
+
+    n, p, q = gen_key(bits, e)
+
+    print("// Generated by ext/python_dissembler/rsa_key.py %s%u -- do not edit." %
+            ("-p " if private else "", bits))
+    if not private:
+        print(c_bytes(n, bits // 8) + ", 0x%x" % e)
+        return
+
+    d = inverse(e, (p - 1) * (q - 1))
+    half = bits // 16
+    fields = [(d, bits // 8), (p, half), (q, half), (d % (p - 1), half),
+            (d % (q - 1), half), (inverse(q, p), half)]
+    print(",\n".join(c_bytes(v, length) for v, length in fields))
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,123 @@
+from __future__ import print_function
+
+# Decode the persistent event trace (src/trace.h) from a FRAM dump.
+#
+# usage: python trace_decode.py mem.src dump [tick_us]
+#
+#   mem.src   objdump -x of the traced binary (compile.sh writes it here)
+#   dump      trace_log contents, either raw binary or Intel HEX, e.g.
+#             mspdebug tilib "hexout <addr> <size> trace.hex"
+#             (run without a dump to print addr and size)
+#   tick_us   microseconds per Timer_A0 tick (default 1: SMCLK 8MHz / 8)
+
+import sys
+import re
+import struct
+from collections import defaultdict
+
+EV_BOOT = 0x1
+EV_START = 0x2
+EV_SITE = 0x3
+EV_NAMES = {EV_BOOT: "boot", EV_START: "start", EV_SITE: "site"}
+
+SITE_ITER_BEGIN = 0
+SITE_ITER_END = 1
+
+def find_symbol(mem_src, name):
+    for line in open(mem_src):
+        sym = re.match(r"^(?P<addr>[0-9a-f]+) .*\t(?P<size>[0-9a-f]+) " +
+                name + "$", line.strip())
+        if sym is not None:
+            return int(sym.group("addr"), 16), int(sym.group("size"), 16)
+    raise SystemExit("symbol " + name + " not found in " + mem_src)
+
+def read_dump(path, base, size):
+    data = open(path, "rb").read()
+    if not data.startswith(b":"):
+        return data[:size]
+
+    # Intel HEX: only data records (type 00) matter here
+    mem = bytearray(size)
+    for line in data.decode("ascii").split():
+        rec = bytearray.fromhex(line[1:])
+        count, addr, rtype = rec[0], (rec[1] << 8) | rec[2], rec[3]
+        if rtype != 0:
+            continue
+        for i in range(count):
+            off = addr + i - base
+            if 0 <= off < size:
+                mem[off] = rec[4 + i]
+    return bytes(mem)
+
+def records(dump):
+    # trace_log_t: uint16_t head; trace_rec_t rec[TRACE_LEN];
+    head = struct.unpack_from("<H", dump, 0)[0]
+    n = (len(dump) - 2) // 4
+    recs = [struct.unpack_from("<HH", dump, 2 + 4 * i) for i in range(n)]
+    # Oldest record sits at head once the ring has wrapped
+    for tag, ts in recs[head:] + recs[:head]:
+        if tag >> 12 != 0:
+            yield tag >> 12, tag & 0x0fff, ts
+
+def bucket(ticks):
+    b = 0
+    while (1 << b) <= ticks:
+        b += 1
+    return b
+
+def main():
+    if len(sys.argv) < 2:
+        raise SystemExit("usage: trace_decode.py mem.src [dump [tick_us]]")
+    base, size = find_symbol(sys.argv[1], "trace_log")
+    if len(sys.argv) < 3:
+        print("trace_log: addr 0x%04x size %u" % (base, size))
+        print("mspdebug tilib \"hexout 0x%04x %u trace.hex\"" % (base, size))
+        return
+    tick_us = float(sys.argv[3]) if len(sys.argv) > 3 else 1.0
+
+    dump = read_dump(sys.argv[2], base, size)
+
+    ev_count = defaultdict(int)
+    site_count = defaultdict(int)
+    site_lat = defaultdict(lambda: defaultdict(int))
+    boots_per_iter = []
+    boots = 0
+    prev_ts = None
+    for ev, site, ts in records(dump):
+        ev_count[ev] += 1
+        if ev == EV_BOOT:
+            boots += 1
+            prev_ts = None # timer restarts on every boot
+            continue
+        if ev == EV_SITE:
+            site_count[site] += 1
+            if prev_ts is not None:
+                site_lat[site][bucket((ts - prev_ts) & 0xffff)] += 1
+            if site == SITE_ITER_END:
+                boots_per_iter.append(boots)
+                boots = 0
+        prev_ts = ts
+
+    print("events:")
+    for ev in sorted(ev_count):
+        print("  %-6s %u" % (EV_NAMES.get(ev, "?%x" % ev), ev_count[ev]))
+    print("  restores %u" % (ev_count[EV_BOOT] - ev_count[EV_START]))
+
+    if boots_per_iter:
+        print("reboots per iteration (%u complete iterations):" %
+                len(boots_per_iter))
+        hist = defaultdict(int)
+        for b in boots_per_iter:
+            hist[b] += 1
+        for b in sorted(hist):
+            print("  %4u: %u" % (b, hist[b]))
+
+    print("sites (latency since previous event, same power cycle):")
+    for site in sorted(site_count):
+        print("  site %u: %u hits" % (site, site_count[site]))
+        for b in sorted(site_lat[site]):
+            print("    < %8.0f us: %u" % (((1 << b) * tick_us),
+                site_lat[site][b]))
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,144 @@
+#ifndef ATOMIC_H
+#define ATOMIC_H
+
+// All-or-nothing updates of persistent data, checkpointed at the
+// boundaries only.
+//
+//   RATCHET_ATOMIC_BEGIN();
+//   RATCHET_ATOMIC_LOG(stats->total);
+//   stats->total++;
+//   RATCHET_ATOMIC_LOG(stats->moving);
+//   stats->moving++;
+//   RATCHET_ATOMIC_END();
+//
+// Between the markers ratchet_backend.py drops the checkpoints the pass
+// put at the writes-after-reads. Instead, RATCHET_ATOMIC_LOG() saves the
+// old value of each object in an undo log in FRAM before it is written,
+// and BEGIN and END take one checkpoint each. A power failure in between
+// resumes at BEGIN's checkpoint: RATCHET_ATOMIC_BOOT(), called before
+// restore_regs(), first writes the logged values back, newest first, so
+// the region runs again on the data it started from.
+//
+// The log belongs to the checkpoint it was opened after. Ratchet double
+// buffers its checkpoints and flips cur_reg on every one it commits, so
+// if cur_reg has moved on, END's checkpoint got through and the log is
+// dropped instead.
+//
+// Inside a region:
+//  - every persistent object written must be logged first, each time it
+//    may be written (an object logged twice is restored to the older
+//    value);
+//  - locals from before BEGIN must not be assigned: the stack is in FRAM
+//    and is not rolled back;
+//  - no application function may be called (its own checkpoints would
+//    split the region); the backend stops the build if one is.
+//
+// A region that only writes values computed from data it does not write
+// gives the same result when run again from the start, and needs no log.
+// An object updated through a volatile pointer is not rolled back either,
+// which makes a counter of the runs of a region.
+//
+// Without RATCHET the markers and the log compile to nothing.
+
+#include <stdint.h>
+
+#ifndef ATOMIC_LOG_WORDS
+#define ATOMIC_LOG_WORDS 16 // 16-bit words logged per region
+#endif
+
+#ifdef RATCHET
+
+void checkpoint(void);
+
+typedef struct {
+	uint16_t *addr[ATOMIC_LOG_WORDS];
+	uint16_t old[ATOMIC_LOG_WORDS];
+	unsigned count; // entries; 0 when no region is open
+	void *owner;    // cur_reg after the checkpoint at BEGIN
+} atomic_log_t;
+
+__nv atomic_log_t atomic_log = {{0}};
+
+// The log is only accessed through a volatile pointer, so the pass sees no
+// writes-after-reads in it. The helpers are inlined even at -O0: a call
+// from a region to a function of the application is rejected.
+#define ATOMIC_INLINE static inline __attribute__((always_inline))
+
+ATOMIC_INLINE void atomic_open()
+{
+	volatile atomic_log_t *log = &atomic_log;
+
+	log->count = 0;
+	log->owner = (void *)cur_reg;
+}
+
+// An entry is written before it is counted, and counted before the word
+// it saves is written
+ATOMIC_INLINE void atomic_log_words(uint16_t *addr, unsigned n)
+{
+	volatile atomic_log_t *log = &atomic_log;
+	unsigned count = log->count;
+
+	if (count + n > ATOMIC_LOG_WORDS) {
+		// Stop rather than break atomicity: raise ATOMIC_LOG_WORDS
+		while (1);
+	}
+	while (n--) {
+		log->addr[count] = addr;
+		log->old[count] = *addr++;
+		log->count = ++count;
+	}
+}
+
+ATOMIC_INLINE void atomic_close()
+{
+	volatile atomic_log_t *log = &atomic_log;
+
+	log->count = 0;
+}
+
+// Called on every boot, before restore_regs(). Undoing is idempotent, so a
+// failure here only means undoing again on the next boot.
+ATOMIC_INLINE void atomic_boot()
+{
+	volatile atomic_log_t *log = &atomic_log;
+	unsigned count = log->count;
+
+	if (count && log->owner == (void *)cur_reg) {
+		while (count--)
+			*log->addr[count] = log->old[count];
+	}
+	log->count = 0;
+}
+
+// The markers are assembler comments, which ratchet_backend.py looks for
+#define RATCHET_ATOMIC_BEGIN() do { \
+	checkpoint(); \
+	__asm__ volatile ("; RATCHET_ATOMIC_BEGIN" ::: "memory"); \
+	atomic_open(); \
+} while (0)
+
+#define RATCHET_ATOMIC_END() do { \
+	__asm__ volatile ("; RATCHET_ATOMIC_END" ::: "memory"); \
+	checkpoint(); \
+	atomic_close(); \
+} while (0)
+
+// Objects are logged as whole 16-bit words: even size, word aligned
+#define RATCHET_ATOMIC_LOG(x) do { \
+	(void)sizeof(char[1 - 2 * (sizeof(x) & 1)]); \
+	atomic_log_words((uint16_t *)&(x), sizeof(x) / 2); \
+} while (0)
+
+#define RATCHET_ATOMIC_BOOT() atomic_boot()
+
+#else // !RATCHET
+
+#define RATCHET_ATOMIC_BEGIN()
+#define RATCHET_ATOMIC_END()
+#define RATCHET_ATOMIC_LOG(x)
+#define RATCHET_ATOMIC_BOOT()
+
+#endif // RATCHET
+
+#endif
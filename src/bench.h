@@ -0,0 +1,66 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+// Cycle counting for the benchmarks.
+//
+// Build with BENCH=1 (and LOGIC=0 to get the console). Timer_B0 runs
+// from SMCLK, assumed equal to MCLK (DCO, see bld/Makefile.config), so one
+// tick is 2^BENCH_SHIFT CPU cycles. A single measured span must stay below
+// 2^(16 + BENCH_SHIFT) cycles; sum short spans for longer runs. Numbers are
+// only meaningful on continuous power.
+//
+// Without BENCH everything here reads as zero and BENCH_PRINTF is dropped.
+
+#include <stdint.h>
+
+#ifndef BENCH_SHIFT
+#define BENCH_SHIFT 0 // 0..6
+#endif
+
+typedef uint16_t bench_t;
+
+// Inlined even at -O0, so that they can be used in an atomic region
+// (src/atomic.h)
+#define BENCH_INLINE static inline __attribute__((always_inline))
+
+#ifdef BENCH
+
+#if BENCH_SHIFT <= 3
+#define BENCH_ID   (BENCH_SHIFT << 6)
+#define BENCH_IDEX 0
+#else
+#define BENCH_ID   ID__8
+#define BENCH_IDEX ((1 << (BENCH_SHIFT - 3)) - 1)
+#endif
+
+BENCH_INLINE void bench_init()
+{
+	TB0CTL = MC__STOP | TBCLR;
+	TB0EX0 = BENCH_IDEX;
+	TB0CTL = TBSSEL__SMCLK | BENCH_ID | MC__CONTINUOUS | TBCLR;
+}
+
+BENCH_INLINE bench_t bench_start()
+{
+	return TB0R;
+}
+
+BENCH_INLINE uint32_t bench_elapsed(bench_t start)
+{
+	bench_t ticks = TB0R - start;
+	return (uint32_t)ticks << BENCH_SHIFT;
+}
+
+#define BENCH_PRINTF(...) PRINTF(__VA_ARGS__)
+
+#else // !BENCH
+
+BENCH_INLINE void bench_init() {}
+BENCH_INLINE bench_t bench_start() { return 0; }
+BENCH_INLINE uint32_t bench_elapsed(bench_t start) { return 0; }
+
+#define BENCH_PRINTF(...)
+
+#endif // BENCH
+
+#endif
@@ -0,0 +1,133 @@
+// Generated by ext/python_dissembler/cem_corpus.py -- do not edit.
+// source: synthetic 12-bit sensor trace
+#define CEM_CORPUS_LEN 1024
+#define CEM_CORPUS_INIT { \
+	0x0801, 0x0805, 0x0808, 0x080e, 0x0814, 0x0817, 0x081d, 0x0820, \
+	0x0822, 0x0824, 0x082a, 0x082f, 0x0830, 0x0836, 0x083b, 0x0840, \
+	0x0841, 0x0848, 0x0847, 0x084d, 0x0853, 0x0851, 0x0859, 0x085d, \
+	0x0862, 0x0869, 0x086a, 0x086b, 0x0874, 0x0879, 0x0882, 0x0880, \
+	0x0886, 0x088a, 0x088b, 0x088e, 0x0899, 0x0897, 0x08a1, 0x08a0, \
+	0x08a1, 0x08a5, 0x08a8, 0x08ad, 0x08ac, 0x08b1, 0x08af, 0x08b5, \
+	0x08b7, 0x08ba, 0x08bc, 0x08bd, 0x08c1, 0x08c8, 0x08cc, 0x08ca, \
+	0x08c7, 0x08ce, 0x08d2, 0x08d4, 0x08d6, 0x08d7, 0x08e0, 0x0a3e, \
+	0x0a41, 0x0a40, 0x0a46, 0x0a4a, 0x0a4a, 0x0a51, 0x0a55, 0x0a59, \
+	0x0a57, 0x0a5a, 0x0a5f, 0x0a60, 0x0a65, 0x0a68, 0x0a67, 0x0a68, \
+	0x0a6e, 0x0a72, 0x0a76, 0x0a79, 0x0a7b, 0x0a7b, 0x0a83, 0x0a83, \
+	0x0a86, 0x0a88, 0x0a82, 0x0a8c, 0x0a8b, 0x0a92, 0x0a94, 0x0936, \
+	0x0939, 0x0939, 0x0939, 0x0937, 0x0939, 0x093c, 0x093e, 0x093d, \
+	0x0944, 0x0946, 0x0949, 0x094c, 0x094e, 0x094d, 0x0950, 0x0954, \
+	0x0958, 0x095c, 0x095b, 0x095c, 0x0961, 0x095f, 0x0961, 0x0962, \
+	0x0963, 0x0965, 0x0969, 0x096b, 0x096c, 0x096d, 0x0975, 0x0978, \
+	0x0977, 0x0974, 0x097a, 0x097b, 0x0979, 0x097a, 0x097b, 0x097f, \
+	0x097e, 0x0980, 0x0982, 0x0982, 0x0987, 0x0990, 0x098d, 0x0995, \
+	0x0995, 0x0994, 0x0995, 0x0994, 0x0994, 0x0996, 0x099a, 0x0995, \
+	0x0992, 0x0992, 0x098f, 0x098f, 0x098d, 0x098f, 0x0991, 0x0995, \
+	0x0994, 0x0992, 0x0992, 0x0994, 0x0993, 0x0992, 0x0993, 0x098f, \
+	0x0997, 0x0998, 0x0999, 0x099a, 0x099a, 0x099a, 0x099b, 0x0997, \
+	0x0997, 0x0995, 0x0992, 0x0995, 0x0996, 0x0997, 0x099b, 0x0995, \
+	0x0996, 0x0997, 0x0998, 0x099a, 0x0997, 0x0998, 0x0997, 0x0992, \
+	0x0995, 0x0993, 0x098f, 0x098a, 0x098a, 0x0989, 0x0988, 0x0985, \
+	0x0985, 0x0980, 0x097b, 0x0979, 0x0977, 0x0978, 0x0978, 0x0973, \
+	0x0970, 0x096e, 0x096e, 0x096d, 0x096d, 0x0970, 0x096d, 0x0968, \
+	0x096d, 0x096c, 0x096b, 0x096b, 0x096d, 0x096d, 0x096c, 0x096b, \
+	0x0968, 0x0969, 0x0969, 0x0965, 0x0963, 0x0962, 0x0961, 0x095e, \
+	0x095f, 0x095d, 0x0958, 0x095a, 0x0956, 0x0957, 0x0956, 0x0953, \
+	0x0950, 0x094f, 0x094f, 0x094d, 0x0949, 0x0945, 0x0946, 0x0943, \
+	0x0943, 0x093d, 0x093c, 0x0938, 0x0933, 0x092e, 0x0933, 0x0933, \
+	0x0930, 0x092d, 0x092d, 0x092b, 0x092b, 0x0929, 0x0926, 0x0927, \
+	0x0922, 0x091e, 0x0917, 0x0916, 0x0910, 0x090c, 0x090c, 0x090c, \
+	0x0909, 0x0907, 0x0902, 0x0900, 0x08fd, 0x08fd, 0x08fd, 0x08f5, \
+	0x08f4, 0x08f0, 0x08f0, 0x08ed, 0x08e5, 0x08e5, 0x08e2, 0x08dd, \
+	0x08dc, 0x08d7, 0x08d3, 0x08ce, 0x08cb, 0x08c7, 0x08c5, 0x08c2, \
+	0x08c0, 0x08c1, 0x08bd, 0x08b6, 0x08b8, 0x08b2, 0x08b2, 0x08b0, \
+	0x08aa, 0x08a7, 0x08a5, 0x08a1, 0x089f, 0x089e, 0x0898, 0x089a, \
+	0x0899, 0x0891, 0x088e, 0x0889, 0x088b, 0x0889, 0x0889, 0x0883, \
+	0x087c, 0x0875, 0x0872, 0x0868, 0x0867, 0x0863, 0x085e, 0x085e, \
+	0x085e, 0x0855, 0x084f, 0x084f, 0x0845, 0x0846, 0x0843, 0x0840, \
+	0x083c, 0x0832, 0x082f, 0x082d, 0x082c, 0x0828, 0x0821, 0x0820, \
+	0x0819, 0x08cc, 0x08c8, 0x08c2, 0x08bd, 0x08bf, 0x08be, 0x08ba, \
+	0x08b7, 0x08b3, 0x08b1, 0x08ad, 0x0952, 0x0948, 0x0949, 0x0941, \
+	0x093f, 0x0938, 0x0932, 0x092f, 0x092e, 0x092b, 0x092c, 0x0928, \
+	0x0925, 0x0924, 0x091d, 0x091c, 0x0919, 0x0918, 0x0915, 0x090e, \
+	0x090b, 0x0906, 0x08fe, 0x08fd, 0x08fa, 0x08f3, 0x08f3, 0x08f3, \
+	0x08ef, 0x08e8, 0x08ed, 0x08ea, 0x08e5, 0x08e2, 0x08e4, 0x08e0, \
+	0x08db, 0x08d8, 0x08d4, 0x08cf, 0x08cb, 0x08c7, 0x08ca, 0x08c0, \
+	0x08bf, 0x08b9, 0x08b9, 0x08b6, 0x08ae, 0x08ad, 0x08a8, 0x08a8, \
+	0x089d, 0x089f, 0x0898, 0x0894, 0x0893, 0x0891, 0x0890, 0x088c, \
+	0x0889, 0x0889, 0x0889, 0x0887, 0x0882, 0x0880, 0x0881, 0x0879, \
+	0x0875, 0x0870, 0x086b, 0x0867, 0x0864, 0x0864, 0x0861, 0x085f, \
+	0x085e, 0x0856, 0x0856, 0x0856, 0x0850, 0x084b, 0x0848, 0x0847, \
+	0x0843, 0x0842, 0x0841, 0x083d, 0x0834, 0x082f, 0x0836, 0x0830, \
+	0x082f, 0x082d, 0x0780, 0x077d, 0x077f, 0x077e, 0x077b, 0x077c, \
+	0x0777, 0x0777, 0x0774, 0x0777, 0x0771, 0x076d, 0x076d, 0x076d, \
+	0x076c, 0x0765, 0x0762, 0x0766, 0x0761, 0x0760, 0x0760, 0x075c, \
+	0x075b, 0x0757, 0x0755, 0x0752, 0x0750, 0x074f, 0x074c, 0x074d, \
+	0x074e, 0x074a, 0x0747, 0x0744, 0x0745, 0x0747, 0x0742, 0x0742, \
+	0x073e, 0x0742, 0x0741, 0x0741, 0x073c, 0x073d, 0x073b, 0x0739, \
+	0x0739, 0x0736, 0x0738, 0x072f, 0x0732, 0x0731, 0x072f, 0x072d, \
+	0x072c, 0x072c, 0x072e, 0x072e, 0x0731, 0x072f, 0x0730, 0x0733, \
+	0x0733, 0x0735, 0x0737, 0x0736, 0x0737, 0x0732, 0x0734, 0x0734, \
+	0x0733, 0x0732, 0x0732, 0x0733, 0x0731, 0x0733, 0x0732, 0x0730, \
+	0x072d, 0x072c, 0x072c, 0x072c, 0x072a, 0x0728, 0x0728, 0x072e, \
+	0x072e, 0x0730, 0x072e, 0x072c, 0x072e, 0x072b, 0x072d, 0x072c, \
+	0x072c, 0x072f, 0x072a, 0x072c, 0x0730, 0x072f, 0x0731, 0x0732, \
+	0x0737, 0x0736, 0x0731, 0x0732, 0x0732, 0x0733, 0x0735, 0x0737, \
+	0x0734, 0x0735, 0x0736, 0x0735, 0x073d, 0x073f, 0x0741, 0x0743, \
+	0x0743, 0x0744, 0x0745, 0x0742, 0x0744, 0x0746, 0x0747, 0x074a, \
+	0x0748, 0x074e, 0x0753, 0x0752, 0x0752, 0x0756, 0x075b, 0x075a, \
+	0x075d, 0x080c, 0x080d, 0x080f, 0x0814, 0x0814, 0x0816, 0x0815, \
+	0x081b, 0x081b, 0x081b, 0x0821, 0x0824, 0x0826, 0x0826, 0x082d, \
+	0x082d, 0x0833, 0x083a, 0x0839, 0x083b, 0x0839, 0x0842, 0x0844, \
+	0x0842, 0x0847, 0x0843, 0x0845, 0x084b, 0x084f, 0x0855, 0x0855, \
+	0x0855, 0x0859, 0x0859, 0x085c, 0x0863, 0x0864, 0x0866, 0x086a, \
+	0x086a, 0x086d, 0x086f, 0x086f, 0x0877, 0x0879, 0x087a, 0x0878, \
+	0x087d, 0x0886, 0x0884, 0x088d, 0x088d, 0x088f, 0x0890, 0x0890, \
+	0x0895, 0x0897, 0x0899, 0x089a, 0x089d, 0x08a0, 0x08a7, 0x0804, \
+	0x0804, 0x0808, 0x0805, 0x0809, 0x080a, 0x0809, 0x080f, 0x0810, \
+	0x0812, 0x0815, 0x081b, 0x081a, 0x081e, 0x081f, 0x0829, 0x082c, \
+	0x082c, 0x082f, 0x0831, 0x083a, 0x083d, 0x083f, 0x083f, 0x0842, \
+	0x0844, 0x0849, 0x084e, 0x0851, 0x0854, 0x0852, 0x0857, 0x085a, \
+	0x0865, 0x0863, 0x0866, 0x0865, 0x086d, 0x086e, 0x0870, 0x0875, \
+	0x087f, 0x087f, 0x0885, 0x0888, 0x0888, 0x088a, 0x088d, 0x088e, \
+	0x0893, 0x0893, 0x0896, 0x089e, 0x08a0, 0x08a3, 0x08a8, 0x08af, \
+	0x08b0, 0x08b3, 0x08b7, 0x08b9, 0x08c1, 0x08c6, 0x08ca, 0x08d0, \
+	0x08d2, 0x08d3, 0x08da, 0x08db, 0x08e5, 0x08e6, 0x08e8, 0x08ed, \
+	0x08f0, 0x08f3, 0x08fe, 0x0900, 0x0906, 0x090a, 0x090b, 0x0914, \
+	0x0916, 0x0918, 0x091d, 0x091d, 0x0924, 0x0927, 0x092a, 0x092a, \
+	0x092f, 0x0934, 0x0936, 0x0938, 0x093a, 0x093b, 0x093d, 0x0947, \
+	0x094a, 0x094c, 0x094f, 0x0951, 0x0953, 0x0957, 0x0958, 0x0956, \
+	0x095d, 0x095f, 0x0962, 0x0964, 0x0967, 0x096a, 0x096e, 0x0970, \
+	0x0972, 0x0975, 0x0975, 0x097d, 0x097f, 0x097e, 0x0981, 0x0987, \
+	0x0989, 0x098e, 0x0991, 0x098c, 0x0998, 0x0a42, 0x0a43, 0x0a49, \
+	0x0a4f, 0x0a4f, 0x0a55, 0x0a5a, 0x0a5f, 0x0a62, 0x0a65, 0x0a68, \
+	0x0a6a, 0x0a6d, 0x0a70, 0x0a73, 0x0a78, 0x0a77, 0x0a7b, 0x0a78, \
+	0x0a7d, 0x0a85, 0x0a81, 0x0a87, 0x0a8a, 0x0a8e, 0x0a8c, 0x0a91, \
+	0x0a91, 0x0a8f, 0x0a8f, 0x0a93, 0x0a98, 0x0a98, 0x0a97, 0x093d, \
+	0x0941, 0x0943, 0x0943, 0x0945, 0x0944, 0x0948, 0x094a, 0x094e, \
+	0x0955, 0x0955, 0x095a, 0x0957, 0x0954, 0x095a, 0x095b, 0x0958, \
+	0x095d, 0x095b, 0x095c, 0x095f, 0x0960, 0x0965, 0x0964, 0x0963, \
+	0x0968, 0x0967, 0x096c, 0x096c, 0x096a, 0x0971, 0x096f, 0x096e, \
+	0x0968, 0x096e, 0x0970, 0x0971, 0x0972, 0x0977, 0x0978, 0x0977, \
+	0x097c, 0x097d, 0x097e, 0x097c, 0x097f, 0x097c, 0x097c, 0x0982, \
+	0x0983, 0x0987, 0x098a, 0x0988, 0x098a, 0x098e, 0x098c, 0x098c, \
+	0x098e, 0x0991, 0x0992, 0x098e, 0x0990, 0x0992, 0x0994, 0x0995, \
+	0x0992, 0x0991, 0x0990, 0x098f, 0x0990, 0x0992, 0x0990, 0x0991, \
+	0x0993, 0x098d, 0x0993, 0x0993, 0x0992, 0x0995, 0x0998, 0x0998, \
+	0x0992, 0x0996, 0x0998, 0x0998, 0x0997, 0x0997, 0x0994, 0x0990, \
+	0x098c, 0x098b, 0x098c, 0x0986, 0x0988, 0x0984, 0x0983, 0x0984, \
+	0x097e, 0x0984, 0x0982, 0x0982, 0x0981, 0x0985, 0x0988, 0x0984, \
+	0x0983, 0x0984, 0x0985, 0x097e, 0x097d, 0x0979, 0x097d, 0x097a, \
+	0x0975, 0x0973, 0x0973, 0x096f, 0x096c, 0x096d, 0x096c, 0x096a, \
+	0x0965, 0x0960, 0x0968, 0x0963, 0x0961, 0x0963, 0x0962, 0x0960, \
+	0x0959, 0x0958, 0x0958, 0x0955, 0x0950, 0x094e, 0x094b, 0x0946, \
+	0x0942, 0x0946, 0x0949, 0x0940, 0x0941, 0x093d, 0x0937, 0x0936, \
+	0x0931, 0x0930, 0x0933, 0x092d, 0x092d, 0x092a, 0x0927, 0x0922, \
+	0x0925, 0x091e, 0x0923, 0x091e, 0x091e, 0x091b, 0x0915, 0x0913, \
+	0x0914, 0x0910, 0x090a, 0x090a, 0x0908, 0x0903, 0x08ff, 0x08ff, \
+	0x08fc, 0x08fc, 0x08fa, 0x08f5, 0x08f6, 0x08f4, 0x08f3, 0x08f3, \
+	0x08ec, 0x08e8, 0x08e5, 0x08e4, 0x08de, 0x08de, 0x08db, 0x08d8, \
+	0x08d5, 0x08d3, 0x08d0, 0x08cf, 0x08c9, 0x08c5, 0x08c0, 0x08c2, \
+	0x08be, 0x08b8, 0x08b3, 0x08b2, 0x08ab, 0x08ab, 0x08a6, 0x08a2, \
+	0x089b, 0x0898, 0x0894, 0x088d, 0x088b, 0x0888, 0x0880, 0x09d7, \
+	0x09d9, 0x09d3, 0x09d1, 0x09cc, 0x09c9, 0x09c8, 0x09c5, 0x09c0, \
+}
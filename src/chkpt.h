@@ -0,0 +1,37 @@
+#ifndef CHKPT_H
+#define CHKPT_H
+
+// Checkpoint counting, for comparing how often variants of an app
+// checkpoint.
+//
+// Build with CHKPT_COUNT=1 (bld/Makefile): ratchet_backend.py then bumps
+// chkpt_counter in front of every checkpoint left in the app, whether the
+// pass put it at a WAR or at a function return, or it opens or closes an
+// atomic region. The counter is in FRAM and read and cleared through a
+// volatile pointer, out of the pass's sight, so it also counts checkpoints
+// taken before a power failure. Without CHKPT_COUNT it reads 0.
+
+#include <stdint.h>
+
+#ifdef CHKPT_COUNT
+
+__nv uint32_t chkpt_counter = 0;
+
+static inline void chkpt_reset()
+{
+	*(volatile uint32_t *)&chkpt_counter = 0;
+}
+
+static inline uint32_t chkpt_count()
+{
+	return *(volatile uint32_t *)&chkpt_counter;
+}
+
+#else // !CHKPT_COUNT
+
+static inline void chkpt_reset() {}
+static inline uint32_t chkpt_count() { return 0; }
+
+#endif // CHKPT_COUNT
+
+#endif
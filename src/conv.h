@@ -0,0 +1,152 @@
+#ifndef CONV_H
+#define CONV_H
+
+// 1-D convolution kernels:
+//   out[i] = sum_j in[i + j] * kernel[k - 1 - j]   for i < n_out
+// so in[] must hold n_out + k - 1 samples. Arithmetic wraps at 16 bits,
+// the same in every variant, so they produce identical outputs.
+//
+//   conv_naive  reference double loop, accumulates in out[] (a FRAM
+//               read-modify-write per tap)
+//   conv_box    uniform kernel (every tap == weight): running sum, O(1)
+//               per output
+//   conv_fir    any kernel: multiply-accumulate (mac.h) over a delay
+//               line in SRAM, O(k) per output. A power failure wipes the
+//               delay line, so under Ratchet conv_fir must run in an
+//               atomic region, which starts it over; conv_tiled() and
+//               the benchmark run it in one.
+
+#include "mac.h"
+#include "atomic.h"
+
+#define CONV_K_MAX 64 // longest kernel conv_fir takes
+
+// Inlined even at -O0, so that conv_tiled() runs them in an atomic region
+#define CONV_INLINE static inline __attribute__((always_inline))
+
+// Ratchet's linker script puts all data in FRAM and gives SRAM no section,
+// so the delay line is placed by hand at the bottom of SRAM (0x1C00-0x23FF
+// on the FR5969), which only the restore sequence otherwise uses, as a
+// stack growing down from the top (ratchet_backend.py). It is written
+// through a volatile pointer, which the pass does not instrument.
+#ifdef RATCHET
+#define CONV_DELAY ((volatile unsigned *)0x1C00)
+#else
+static unsigned conv_delay[2 * CONV_K_MAX];
+#define CONV_DELAY conv_delay
+#endif
+
+// Methods for conv_run() and conv_tiled()
+#define CONV_NAIVE 0
+#define CONV_BOX   1 // every tap must equal kernel[0]
+#define CONV_FIR   2
+
+CONV_INLINE void conv_naive(const unsigned *in, unsigned *out, unsigned n_out,
+		const unsigned *kernel, unsigned k)
+{
+	for (unsigned i = 0; i < n_out; ++i)
+		out[i] = 0;
+
+	for (unsigned i = 0; i < n_out; ++i)
+		for (unsigned j = 0; j < k; ++j)
+			out[i] += in[i+j]*kernel[k-(j+1)];
+}
+
+CONV_INLINE void conv_box(const unsigned *in, unsigned *out, unsigned n_out,
+		unsigned k, unsigned weight)
+{
+	unsigned sum = 0;
+
+	for (unsigned j = 0; j < k - 1; ++j)
+		sum += in[j];
+
+	for (unsigned i = 0; i < n_out; ++i) {
+		sum += in[i + k - 1];
+		out[i] = (weight == 1) ? sum : sum * weight;
+		sum -= in[i];
+	}
+}
+
+CONV_INLINE void conv_fir(const unsigned *in, unsigned *out, unsigned n_out,
+		const unsigned *kernel, unsigned k)
+{
+	// Every sample is stored twice, k apart, so the last k samples are
+	// always contiguous at delay[newest + 1 .. newest + k], oldest first,
+	// and the tap loop needs no wrap-around.
+	volatile unsigned *delay = CONV_DELAY;
+	unsigned newest = k - 1;
+
+	for (unsigned i = 0; i < n_out + k - 1; ++i) {
+		newest = (newest + 1 == k) ? 0 : newest + 1;
+		delay[newest] = in[i];
+		delay[newest + k] = in[i];
+
+		if (i + 1 < k) // delay line not full yet
+			continue;
+
+		out[i + 1 - k] = mac_dot_rev16((const unsigned *)&delay[newest + 1],
+				&kernel[k - 1], k);
+	}
+}
+
+CONV_INLINE void conv_run(unsigned method, const unsigned *in, unsigned *out,
+		unsigned n_out, const unsigned *kernel, unsigned k)
+{
+	if (method == CONV_NAIVE)
+		conv_naive(in, out, n_out, kernel, k);
+	else if (method == CONV_BOX)
+		conv_box(in, out, n_out, k, kernel[0]);
+	else
+		conv_fir(in, out, n_out, kernel, k);
+}
+
+// Resumable, tiled convolution.
+//
+// Outputs are computed CONV_TILE at a time, straight into out[]. Each tile
+// is an atomic region (atomic.h) that ends by storing the next tile index
+// in progress->tile, which commits it. The pass's checkpoints in the
+// kernels, on their loop counters and sums (per output in conv_box and
+// conv_fir, per tap in conv_naive), give way to the two at the region's
+// ends. A kernel writes out[] from in[] and the kernel alone (conv_naive
+// clears its outputs before summing into them), so a tile cut short by a
+// power failure is run again from its start and needs no undo log.
+//
+// progress->started is bumped through a volatile pointer, out of the
+// pass's sight, and so is not rolled back: it counts the runs of tiles,
+// the ones a failure cut short included. Each tile re-primes its window,
+// k - 1 extra input samples per tile. A larger tile takes fewer
+// checkpoints and throws more work away per failure, and must fit in what
+// one charge of the energy buffer can run, or it never completes.
+#ifndef CONV_TILE
+#define CONV_TILE 32 // outputs per tile, 0 to write out[] directly
+#endif
+
+typedef struct _conv_progress_t {
+	unsigned tile;    // tiles committed to out[]
+	unsigned started; // tiles begun, including ones redone after a failure
+} conv_progress_t;
+
+#if CONV_TILE > 0
+static void conv_tiled(unsigned method, const unsigned *in, unsigned *out,
+		unsigned n_out, const unsigned *kernel, unsigned k,
+		conv_progress_t *progress)
+{
+	while (1) {
+		unsigned tile = progress->tile;
+		unsigned first = tile * CONV_TILE;
+
+		if (first >= n_out)
+			break;
+
+		unsigned len = (n_out - first < CONV_TILE) ? n_out - first : CONV_TILE;
+
+		RATCHET_ATOMIC_BEGIN();
+		(*(volatile unsigned *)&progress->started)++;
+		conv_run(method, &in[first], &out[first], len, kernel, k);
+		progress->tile = tile + 1; // commit
+		RATCHET_ATOMIC_END();
+	}
+}
+#endif
+
+#endif
@@ -0,0 +1,101 @@
+#ifndef FAIL_H
+#define FAIL_H
+
+// Emulated power failures, for measuring re-execution cost on a bench supply.
+//
+// Build with FAIL=<period> (bld/Makefile), in ticks of SMCLK/64 (8 us at
+// 8 MHz). Timer_A2 starts at every boot and, after a period drawn
+// uniformly from [0.75, 1.25) * FAIL_PERIOD, resets the chip with a
+// software POR: FRAM keeps its contents, everything else starts over, as
+// on a real brown-out. The jitter keeps failures from always landing on
+// the same instruction.
+//
+// fail_failures() counts the resets and fail_elapsed() the on-time summed
+// over all boots since fail_reset(), so runs at several periods can be
+// compared on throughput and wasted work.
+//
+// Like the profiler ISR, the reset ISR is plain assembly, out of reach of
+// the Ratchet pass: it must never checkpoint.
+
+#include <stdint.h>
+
+#ifdef FAIL_PERIOD
+
+#if FAIL_PERIOD < 16 || FAIL_PERIOD > 0xc000
+#error FAIL_PERIOD out of range
+#endif
+
+// TIMER2_A0_VECTOR (0xFFDC)
+#define FAIL_VECTOR_SECTION "__interrupt_vector_39"
+
+#define FAIL_STR_INNER(x) #x
+#define FAIL_STR(x) FAIL_STR_INNER(x)
+
+__nv unsigned fail_count = 0;
+__nv uint32_t fail_ticks = 0;
+__nv uint16_t fail_lfsr = 0xace1;
+
+__asm__(
+	"	.text\n"
+	"	.balign	2\n"
+	"fail_isr:\n"
+	"	add	#1, &fail_count\n"
+	"	add	&TA2CCR0, &fail_ticks\n"
+	"	adc	&fail_ticks+2\n"
+	"	mov	#" FAIL_STR(PMMPW | PMMSWPOR) ", &PMMCTL0\n"
+	"1:\n"
+	"	jmp	1b\n"
+	"	.section	" FAIL_VECTOR_SECTION ",\"ax\",@progbits\n"
+	"	.word	fail_isr\n"
+	"	.text\n"
+);
+
+// Called on every boot, before restore_regs(). The LFSR is stepped through
+// a volatile pointer so that the Ratchet pass sees no WAR here (it must
+// not checkpoint before the restore).
+static inline void fail_boot()
+{
+	volatile uint16_t *lfsr = &fail_lfsr;
+	uint16_t x = *lfsr;
+
+	x = (x >> 1) ^ (-(x & 1) & 0xb400);
+	*lfsr = x;
+
+	TA2CTL = MC__STOP | TACLR;
+	TA2EX0 = TAIDEX_7; // /8, after ID__8
+	TA2CCR0 = FAIL_PERIOD - FAIL_PERIOD / 4 +
+		(uint16_t)(mult16(x, FAIL_PERIOD / 2) >> 16);
+	TA2CCTL0 = CCIE;
+	TA2CTL = TASSEL__SMCLK | ID__8 | MC__UP | TACLR;
+}
+
+static inline void fail_reset()
+{
+	fail_count = 0;
+	fail_ticks = 0;
+}
+
+static inline unsigned fail_failures()
+{
+	return *(volatile unsigned *)&fail_count;
+}
+
+// SMCLK/64 ticks of on-time since fail_reset(), this boot included
+static inline uint32_t fail_elapsed()
+{
+	return *(volatile uint32_t *)&fail_ticks + TA2R;
+}
+
+#define FAIL_BOOT() fail_boot()
+
+#else // !FAIL_PERIOD
+
+static inline void fail_reset() {}
+static inline unsigned fail_failures() { return 0; }
+static inline uint32_t fail_elapsed() { return 0; }
+
+#define FAIL_BOOT()
+
+#endif // FAIL_PERIOD
+
+#endif
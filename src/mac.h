@@ -0,0 +1,198 @@
+#ifndef MAC_H
+#define MAC_H
+
+// Multiply-accumulate on the MPY32 peripheral.
+//
+// A product written as a * b in C costs a call into the multiply helper,
+// which loads the operands, waits for the result and reads it back. Here
+// operands go straight into the multiplier in MAC mode and the products
+// add up in RESHI:RESLO, read once at the end:
+//
+//   MAC_BEGIN(m);
+//   for (...)
+//       MAC(m, a[i], b[i]);
+//   sum = MAC_END(m);
+//
+// Unsigned 16x16 products, summed to 32 bits; the caller must keep the
+// sum below 2^32 (the carry out of RESHI is dropped), except with
+// mac_dot_rev_wide(), which counts it.
+//
+// The accumulator is machine state that neither ISRs nor Ratchet's
+// checkpoints preserve, so a sequence must not be split by either:
+//  - MAC_BEGIN() disables interrupts and MAC_END() restores GIE, so an ISR
+//    that multiplies cannot clobber the sum (interrupts are held off for
+//    the length of one sequence, a few cycles per product);
+//  - the pass must place no checkpoint between MAC_BEGIN() and MAC_END().
+//    It places one at every return from a function of the app and at
+//    writes-after-reads, and at -O0 every local is a slot on the stack,
+//    which is FRAM. So the macros are expanded in place and store nothing
+//    after clearing the accumulator, and a sequence may only read memory:
+//    no calls, no assignments, locals included, and so no loops, whose
+//    counters are stored back every iteration. mac_dot_rev() keeps its
+//    loop in registers, in assembly. A power failure mid-sequence then
+//    resumes at an earlier checkpoint, from where MAC_BEGIN() clears the
+//    accumulator and the sequence reruns.
+//
+// Build with MAC=0 (bld/Makefile) to get the same interface on mult16(),
+// one helper call per product, to compare cycles with BENCH=1.
+
+#include <stdint.h>
+
+#ifndef MAC_HW
+#define MAC_HW 1
+#endif
+
+#if MAC_HW
+
+typedef __istate_t mac_t; // interrupt state at MAC_BEGIN()
+
+// The state is stored before the accumulator is cleared
+#define MAC_BEGIN(m)  mac_t m = __get_interrupt_state(); \
+	__disable_interrupt(); \
+	RESLO = 0; \
+	RESHI = 0
+
+// Writing OP2 starts the multiply-add. A 16x16 result is ready for the
+// next instruction unless that reads it indirectly; the registers are only
+// ever accessed at absolute addresses here, so no NOPs are needed.
+#define MAC(m, a, b)  (MAC = (a), OP2 = (b))
+
+// The sum is read before anything is stored
+#define MAC_END(m) ({ \
+	uint32_t mac_sum = RESLO | ((uint32_t)RESHI << 16); \
+	__set_interrupt_state(m); \
+	mac_sum; \
+})
+
+// Low 16 bits of the sum only: one register read
+#define MAC_END16(m) ({ \
+	uint16_t mac_sum = RESLO; \
+	__set_interrupt_state(m); \
+	mac_sum; \
+})
+
+#else // !MAC_HW
+
+#define MAC_BEGIN(m)  uint32_t m = 0
+#define MAC(m, a, b)  (m += mult16(a, b))
+#define MAC_END(m)    (m)
+#define MAC_END16(m)  ((uint16_t)(m))
+
+#endif // MAC_HW
+
+// Inlined even at -O0, so no call returns through a checkpoint
+#define MAC_INLINE static inline __attribute__((always_inline))
+
+// sum_j x[j] * y[-j], for j < n: the tap loop of a convolution, with the
+// kernel (or the other multiplicand) walked backwards
+#if MAC_HW
+MAC_INLINE uint32_t mac_dot_rev(const unsigned *x, const unsigned *y,
+		unsigned n)
+{
+	uint16_t lo, hi, tmp;
+	mac_t state = __get_interrupt_state();
+
+	__disable_interrupt();
+	// From clearing the accumulator to reading it back in one block, with
+	// the pointers and the count in registers. Loads go through tmp: not
+	// every assembler takes @Rn+ with an absolute destination.
+	__asm__ volatile (
+		"\tclr.w\t&RESLO\n"
+		"\tclr.w\t&RESHI\n"
+		"\ttst.w\t%[n]\n"
+		"\tjz\t2f\n"
+		"1:\tmov.w\t@%[x]+, %[tmp]\n"
+		"\tmov.w\t%[tmp], &MAC\n"
+		"\tmov.w\t@%[y], &OP2\n"
+		"\tdecd.w\t%[y]\n"
+		"\tdec.w\t%[n]\n"
+		"\tjnz\t1b\n"
+		"2:\tmov.w\t&RESLO, %[lo]\n"
+		"\tmov.w\t&RESHI, %[hi]\n"
+		: [lo] "=r" (lo), [hi] "=r" (hi), [tmp] "=&r" (tmp),
+		  [x] "+r" (x), [y] "+r" (y), [n] "+r" (n)
+		:
+		: "memory");
+	__set_interrupt_state(state);
+	return lo | ((uint32_t)hi << 16);
+}
+
+MAC_INLINE uint16_t mac_dot_rev16(const unsigned *x, const unsigned *y,
+		unsigned n)
+{
+	return (uint16_t)mac_dot_rev(x, y, n);
+}
+
+// *carry + sum_j x[j] * y[-j], for j < n, to 48 bits: a column of a
+// product of 16-bit digits, which can outgrow the accumulator. The sum
+// starts from *carry in RESHI:RESLO, and each carry out of RESHI (SUMEXT
+// after an unsigned MAC) is counted in ext. Returns the low 16 bits and
+// leaves the upper 32 in *carry.
+MAC_INLINE uint16_t mac_dot_rev_wide(const unsigned *x, const unsigned *y,
+		unsigned n, uint32_t *carry)
+{
+	uint16_t lo = *carry, hi = *carry >> 16, ext, tmp;
+	mac_t state = __get_interrupt_state();
+
+	__disable_interrupt();
+	__asm__ volatile (
+		"\tmov.w\t%[lo], &RESLO\n"
+		"\tmov.w\t%[hi], &RESHI\n"
+		"\tclr.w\t%[ext]\n"
+		"\ttst.w\t%[n]\n"
+		"\tjz\t2f\n"
+		"1:\tmov.w\t@%[x]+, %[tmp]\n"
+		"\tmov.w\t%[tmp], &MAC\n"
+		"\tmov.w\t@%[y], &OP2\n"
+		"\tadd.w\t&SUMEXT, %[ext]\n"
+		"\tdecd.w\t%[y]\n"
+		"\tdec.w\t%[n]\n"
+		"\tjnz\t1b\n"
+		"2:\tmov.w\t&RESLO, %[lo]\n"
+		"\tmov.w\t&RESHI, %[hi]\n"
+		: [lo] "+r" (lo), [hi] "+r" (hi), [ext] "=&r" (ext),
+		  [tmp] "=&r" (tmp), [x] "+r" (x), [y] "+r" (y), [n] "+r" (n)
+		:
+		: "memory");
+	__set_interrupt_state(state);
+	*carry = hi | ((uint32_t)ext << 16);
+	return lo;
+}
+#else // !MAC_HW
+MAC_INLINE uint32_t mac_dot_rev(const unsigned *x, const unsigned *y,
+		unsigned n)
+{
+	MAC_BEGIN(m);
+
+	while (n--)
+		MAC(m, *x++, *y--);
+	return MAC_END(m);
+}
+
+MAC_INLINE uint16_t mac_dot_rev16(const unsigned *x, const unsigned *y,
+		unsigned n)
+{
+	MAC_BEGIN(m);
+
+	while (n--)
+		MAC(m, *x++, *y--);
+	return MAC_END16(m);
+}
+
+MAC_INLINE uint16_t mac_dot_rev_wide(const unsigned *x, const unsigned *y,
+		unsigned n, uint32_t *carry)
+{
+	uint32_t sum = *carry, p;
+	uint16_t ext = 0;
+
+	while (n--) {
+		p = mult16(*x++, *y--);
+		sum += p;
+		ext += sum < p;
+	}
+	*carry = (sum >> 16) | ((uint32_t)ext << 16);
+	return (uint16_t)sum;
+}
+#endif // MAC_HW
+
+#endif
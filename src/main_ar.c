@@ -31,9 +31,15 @@
 #endif
 
 #include "pins.h"
+#include "trace.h"
+#include "prof.h"
+#include "mac.h"
+#define BENCH_SHIFT 2 // a scan over 256 model entries is well over 2^16 cycles
+#include "bench.h"
 #ifdef RATCHET
 #include <libratchet/ratchet.h>
 #endif
+#include "atomic.h"
 
 __nv unsigned count = 0;
 __nv unsigned seed = 1;
@@ -41,23 +47,64 @@ __nv unsigned seed = 1;
 // Number of samples to discard before recording training set
 #define NUM_WARMUP_SAMPLES 3
 
-#define ACCEL_WINDOW_SIZE 3
-#define MODEL_SIZE 16
+#ifndef ACCEL_WINDOW_SIZE
+#define ACCEL_WINDOW_SIZE 3 // samples per window, up to 64
+#endif
+// Samples from the start of one window to the next. Below the window size
+// the windows overlap, and the features are updated sample by sample
+// (slide_features) instead of recomputed per window (featurize).
+#ifndef ACCEL_WINDOW_STRIDE
+#define ACCEL_WINDOW_STRIDE ACCEL_WINDOW_SIZE
+#endif
+#if ACCEL_WINDOW_SIZE < 1 || ACCEL_WINDOW_SIZE > 64
+#error ACCEL_WINDOW_SIZE must be 1..64
+#endif
+#if ACCEL_WINDOW_STRIDE < 1 || ACCEL_WINDOW_STRIDE > ACCEL_WINDOW_SIZE
+#error ACCEL_WINDOW_STRIDE must be 1..ACCEL_WINDOW_SIZE
+#endif
+#define ACCEL_SLIDING (ACCEL_WINDOW_STRIDE < ACCEL_WINDOW_SIZE)
+
+// Sums over a window are scaled by the power of two at or above its size
+// (4 for the default of 3), in place of a division
+#define WINDOW_SHIFT \
+	(ACCEL_WINDOW_SIZE <= 1 ? 0 : ACCEL_WINDOW_SIZE <= 2 ? 1 : \
+	 ACCEL_WINDOW_SIZE <= 4 ? 2 : ACCEL_WINDOW_SIZE <= 8 ? 3 : \
+	 ACCEL_WINDOW_SIZE <= 16 ? 4 : ACCEL_WINDOW_SIZE <= 32 ? 5 : 6)
+#ifndef MODEL_SIZE
+#define MODEL_SIZE 16 // training windows per class, up to 256
+#endif
+#if MODEL_SIZE > 256
+#error MODEL_SIZE is at most 256
+#endif
 #define SAMPLE_NOISE_FLOOR 10 // TODO: made up value
 
 // Number of classifications to complete in one experiment
 #define SAMPLES_TO_COLLECT 128
 
+// 0: compare against every model entry (classify_scan); 1: look the votes
+// up in a table built from the model before recognizing (classify_table)
+#ifndef CLASSIFY_METHOD
+#define CLASSIFY_METHOD 1
+#endif
+
 typedef threeAxis_t_8 accelReading;
 static void init_hw()
 {
 	msp_watchdog_disable();
 	msp_gpio_unlock();
 	msp_clock_setup();
+	bench_init();
 }
 
 typedef accelReading accelWindow[ACCEL_WINDOW_SIZE];
 
+// Per-axis sums over a window: wider than a reading, which they outgrow
+typedef struct {
+	unsigned x;
+	unsigned y;
+	unsigned z;
+} accelSums;
+
 typedef struct {
 	unsigned meanmag;
 	unsigned stddevmag;
@@ -73,6 +120,52 @@ typedef struct {
 	features_t moving[MODEL_SIZE];
 } model_t;
 
+// In FRAM rather than on the stack, which it would outgrow beyond 64
+// entries per class, and kept across reboots and experiments
+__nv model_t model;
+
+// The settings a model was trained with; one from a build with others is
+// not used
+#define MODEL_FORMAT 1
+#define MODEL_VERSION (((uint32_t)MODEL_FORMAT << 24) | \
+		((uint32_t)(MODEL_SIZE - 1) << 12) | \
+		((ACCEL_WINDOW_SIZE - 1) << 6) | (ACCEL_WINDOW_STRIDE - 1))
+
+#define MODEL_VALID 0xa55a
+
+// The model is usable once both classes are trained and its votes table
+// is built. Training a class clears valid first, and valid is the last
+// word written once both are done: a single store, so a failure anywhere
+// in between leaves the model marked invalid and it is trained again.
+typedef struct {
+	uint32_t version; // MODEL_VERSION of the classes trained
+	unsigned trained; // 1 << class for each class trained at that version
+	unsigned valid;   // MODEL_VALID, or 0
+} model_mark_t;
+
+__nv model_mark_t model_mark = { 0, 0, 0 };
+
+// Without an explicit mode change there is no retraining; RETRAIN_EVERY
+// experiments (0: never) stands in for a user switching to training
+#ifndef RETRAIN_EVERY
+#define RETRAIN_EVERY 0
+#endif
+
+__nv unsigned experiments = 0;
+
+// Features are sqrt16() of a 16-bit value, so at most 255; the last level
+// stands for anything larger
+#define FEATURE_LEVELS 257
+
+// Votes for CLASS_MOVING over the model, per value of each feature; built
+// with the model and valid whenever model_mark is
+typedef struct {
+	uint16_t mean[FEATURE_LEVELS];
+	uint16_t sd[FEATURE_LEVELS];
+} votes_t;
+
+__nv votes_t votes;
+
 typedef enum {
 	MODE_IDLE = 3,
 	MODE_TRAIN_STATIONARY = 2,
@@ -114,33 +207,35 @@ void acquire_window(accelWindow window)
 	}
 }
 
-void transform(accelWindow window)
+void transform_sample(accelReading *sample)
 {
-	unsigned i = 0;
+	if (sample->x < SAMPLE_NOISE_FLOOR ||
+			sample->y < SAMPLE_NOISE_FLOOR ||
+			sample->z < SAMPLE_NOISE_FLOOR) {
 
-	LOG("transform\r\n");
+		LOG("transform: sample %u %u %u\r\n",
+				sample->x, sample->y, sample->z);
 
-	for (i = 0; i < ACCEL_WINDOW_SIZE; i++) {
-		accelReading *sample = &window[i];
+		sample->x = (sample->x > SAMPLE_NOISE_FLOOR) ? sample->x : 0;
+		sample->y = (sample->y > SAMPLE_NOISE_FLOOR) ? sample->y : 0;
+		sample->z = (sample->z > SAMPLE_NOISE_FLOOR) ? sample->z : 0;
+	}
+}
 
-		if (sample->x < SAMPLE_NOISE_FLOOR ||
-				sample->y < SAMPLE_NOISE_FLOOR ||
-				sample->z < SAMPLE_NOISE_FLOOR) {
+void transform(accelWindow window)
+{
+	unsigned i = 0;
 
-			LOG("transform: sample %u %u %u\r\n",
-					sample->x, sample->y, sample->z);
+	LOG("transform\r\n");
 
-			sample->x = (sample->x > SAMPLE_NOISE_FLOOR) ? sample->x : 0;
-			sample->y = (sample->y > SAMPLE_NOISE_FLOOR) ? sample->y : 0;
-			sample->z = (sample->z > SAMPLE_NOISE_FLOOR) ? sample->z : 0;
-		}
-	}
+	for (i = 0; i < ACCEL_WINDOW_SIZE; i++)
+		transform_sample(&window[i]);
 }
 
 void featurize(features_t *features, accelWindow aWin)
 {
-	accelReading mean;
-	accelReading stddev;
+	accelSums mean;
+	accelSums stddev;
 
 	mean.x = mean.y = mean.z = 0;
 	stddev.x = stddev.y = stddev.z = 0;
@@ -155,9 +250,9 @@ void featurize(features_t *features, accelWindow aWin)
 		 mean.y = mean.y / ACCEL_WINDOW_SIZE;
 		 mean.z = mean.z / ACCEL_WINDOW_SIZE;
 	 */
-	mean.x >>= 2;
-	mean.y >>= 2;
-	mean.z >>= 2;
+	mean.x >>= WINDOW_SHIFT;
+	mean.y >>= WINDOW_SHIFT;
+	mean.z >>= WINDOW_SHIFT;
 
 	for (i = 0; i < ACCEL_WINDOW_SIZE; i++) {
 		stddev.x += aWin[i].x > mean.x ? aWin[i].x - mean.x
@@ -172,12 +267,21 @@ void featurize(features_t *features, accelWindow aWin)
 		 stddev.y = stddev.y / (ACCEL_WINDOW_SIZE - 1);
 		 stddev.z = stddev.z / (ACCEL_WINDOW_SIZE - 1);
 	 */
-	stddev.x >>= 2;
-	stddev.y >>= 2;
-	stddev.z >>= 2;
-
-	unsigned meanmag = mean.x*mean.x + mean.y*mean.y + mean.z*mean.z;
-	unsigned stddevmag = stddev.x*stddev.x + stddev.y*stddev.y + stddev.z*stddev.z;
+	stddev.x >>= WINDOW_SHIFT;
+	stddev.y >>= WINDOW_SHIFT;
+	stddev.z >>= WINDOW_SHIFT;
+
+	MAC_BEGIN(mean_sq);
+	MAC(mean_sq, mean.x, mean.x);
+	MAC(mean_sq, mean.y, mean.y);
+	MAC(mean_sq, mean.z, mean.z);
+	unsigned meanmag = MAC_END16(mean_sq);
+
+	MAC_BEGIN(stddev_sq);
+	MAC(stddev_sq, stddev.x, stddev.x);
+	MAC(stddev_sq, stddev.y, stddev.y);
+	MAC(stddev_sq, stddev.z, stddev.z);
+	unsigned stddevmag = MAC_END16(stddev_sq);
 
 	features->meanmag   = sqrt16(meanmag);
 	features->stddevmag = sqrt16(stddevmag);
@@ -185,7 +289,203 @@ void featurize(features_t *features, accelWindow aWin)
 	LOG("featurize: mean %u sd %u\r\n", features->meanmag, features->stddevmag);
 }
 
-class_t classify(features_t *features, model_t *model)
+#if ACCEL_SLIDING
+// Overlapping windows, updated per sample.
+//
+// featurize() takes per axis the sum of the window, its scaled mean m and
+// the sum of |v - m| over the samples v. The first is a running sum. So is
+// the second, given the number and the sum of the samples at or below m:
+//
+//   sum |v - m| = sum - 2 * below_sum + m * (2 * below - ACCEL_WINDOW_SIZE)
+//
+// These two are kept for the level m last used, and a histogram of the
+// window moves them when m changes, a step per level it moves, so a
+// window costs ACCEL_WINDOW_STRIDE sample updates rather than a pass over
+// ACCEL_WINDOW_SIZE samples. The magnitudes come from isqrt16().
+
+// Values of a transformed sample
+#define ACCEL_LEVELS 256
+
+typedef struct {
+	uint8_t hist[ACCEL_LEVELS]; // samples in the window, per value
+	unsigned sum;
+	unsigned level;     // m at the last slide_features()
+	unsigned below;     // samples <= level
+	unsigned below_sum; // and their sum
+} axis_window_t;
+
+typedef struct {
+	accelWindow samples; // ring; the oldest at head once full
+	unsigned head;
+	unsigned filled;
+	axis_window_t x, y, z;
+} slide_t;
+
+__nv slide_t slide;
+
+// floor(sqrt(x)), by binary search over a table of squares: eight lookups
+// and compares, no multiplies
+#define SQ(i)   ((unsigned)(i) * (unsigned)(i))
+#define SQ4(i)  SQ(i), SQ(i + 1), SQ(i + 2), SQ(i + 3)
+#define SQ16(i) SQ4(i), SQ4(i + 4), SQ4(i + 8), SQ4(i + 12)
+#define SQ64(i) SQ16(i), SQ16(i + 16), SQ16(i + 32), SQ16(i + 48)
+static const uint16_t squares[256] = {
+	SQ64(0), SQ64(64), SQ64(128), SQ64(192)
+};
+
+static unsigned isqrt16(uint16_t x)
+{
+	unsigned r = 0;
+	unsigned bit;
+
+	for (bit = 128; bit; bit >>= 1) {
+		if (squares[r | bit] <= x)
+			r |= bit;
+	}
+	return r;
+}
+
+// Start over with an empty window
+void slide_reset()
+{
+	unsigned i;
+
+	slide.head = 0;
+	slide.filled = 0;
+	for (i = 0; i < ACCEL_LEVELS; ++i) {
+		slide.x.hist[i] = 0;
+		slide.y.hist[i] = 0;
+		slide.z.hist[i] = 0;
+	}
+	slide.x.sum = slide.x.level = slide.x.below = slide.x.below_sum = 0;
+	slide.y.sum = slide.y.level = slide.y.below = slide.y.below_sum = 0;
+	slide.z.sum = slide.z.level = slide.z.below = slide.z.below_sum = 0;
+}
+
+static void axis_add(axis_window_t *a, uint8_t v)
+{
+	a->hist[v]++;
+	a->sum += v;
+	if (v <= a->level) {
+		a->below++;
+		a->below_sum += v;
+	}
+}
+
+static void axis_remove(axis_window_t *a, uint8_t v)
+{
+	a->hist[v]--;
+	a->sum -= v;
+	if (v <= a->level) {
+		a->below--;
+		a->below_sum -= v;
+	}
+}
+
+// Scaled sum of |v - m| over the window, with the mean m returned in *mean.
+// Unsigned arithmetic wraps, but the result is in range.
+static unsigned axis_deviation(axis_window_t *a, unsigned *mean)
+{
+	unsigned m = a->sum >> WINDOW_SHIFT;
+
+	while (a->level < m) {
+		a->level++;
+		a->below += a->hist[a->level];
+		a->below_sum += a->hist[a->level] * a->level;
+	}
+	while (a->level > m) {
+		a->below -= a->hist[a->level];
+		a->below_sum -= a->hist[a->level] * a->level;
+		a->level--;
+	}
+	*mean = m;
+	return (a->sum - 2 * a->below_sum +
+			m * (2 * a->below - ACCEL_WINDOW_SIZE)) >> WINDOW_SHIFT;
+}
+
+static void slide_push(accelReading *sample)
+{
+	accelReading *old = &slide.samples[slide.head];
+
+	if (slide.filled == ACCEL_WINDOW_SIZE) {
+		axis_remove(&slide.x, old->x);
+		axis_remove(&slide.y, old->y);
+		axis_remove(&slide.z, old->z);
+	} else {
+		slide.filled++;
+	}
+	*old = *sample;
+	axis_add(&slide.x, sample->x);
+	axis_add(&slide.y, sample->y);
+	axis_add(&slide.z, sample->z);
+	if (++slide.head == ACCEL_WINDOW_SIZE)
+		slide.head = 0;
+}
+
+// Features of the next window: ACCEL_WINDOW_STRIDE samples on from the
+// last, or a full window after slide_reset()
+void slide_features(features_t *features)
+{
+	accelReading sample;
+	accelSums mean;
+	accelSums stddev;
+	unsigned n = slide.filled < ACCEL_WINDOW_SIZE ?
+		ACCEL_WINDOW_SIZE - slide.filled : ACCEL_WINDOW_STRIDE;
+
+	while (n--) {
+		accel_sample(seed, &sample);
+		seed++;
+		LOG("acquire: sample %u %u %u\r\n", sample.x, sample.y, sample.z);
+		transform_sample(&sample);
+		slide_push(&sample);
+	}
+
+	stddev.x = axis_deviation(&slide.x, &mean.x);
+	stddev.y = axis_deviation(&slide.y, &mean.y);
+	stddev.z = axis_deviation(&slide.z, &mean.z);
+
+	MAC_BEGIN(mean_sq);
+	MAC(mean_sq, mean.x, mean.x);
+	MAC(mean_sq, mean.y, mean.y);
+	MAC(mean_sq, mean.z, mean.z);
+	unsigned meanmag = MAC_END16(mean_sq);
+
+	MAC_BEGIN(stddev_sq);
+	MAC(stddev_sq, stddev.x, stddev.x);
+	MAC(stddev_sq, stddev.y, stddev.y);
+	MAC(stddev_sq, stddev.z, stddev.z);
+	unsigned stddevmag = MAC_END16(stddev_sq);
+
+	features->meanmag   = isqrt16(meanmag);
+	features->stddevmag = isqrt16(stddevmag);
+
+	LOG("featurize: mean %u sd %u\r\n", features->meanmag, features->stddevmag);
+}
+#endif // ACCEL_SLIDING
+
+// Start of a training or recognition run
+void features_begin()
+{
+#if ACCEL_SLIDING
+	slide_reset();
+#endif
+}
+
+// Features of the next window, recomputed or slid
+void next_features(features_t *features)
+{
+#if ACCEL_SLIDING
+	slide_features(features);
+#else
+	accelWindow sampleWindow;
+
+	acquire_window(sampleWindow);
+	transform(sampleWindow);
+	featurize(features, sampleWindow);
+#endif
+}
+
+class_t classify_scan(features_t *features, model_t *model)
 {
 	int move_less_error = 0;
 	int stat_less_error = 0;
@@ -233,24 +533,162 @@ class_t classify(features_t *features, model_t *model)
 	return class;
 }
 
+// Model entry i votes for moving on a feature f when f is strictly closer
+// to its moving value m than to its stationary value s. For m > s that is
+// 2f > s + m, for m < s it is 2f < s + m, and for m == s it never is. So
+// each entry adds one vote over a range of f, and the votes of the whole
+// model are a prefix sum over the ranges, built once per model; a
+// classification is then two lookups, whatever MODEL_SIZE, with the same
+// votes as classify_scan().
+static void add_votes(uint16_t *table, unsigned s, unsigned m)
+{
+	unsigned t = s + m;
+	unsigned v;
+
+	if (m > s) {
+		v = t / 2 + 1; // f >= v
+		if (v < FEATURE_LEVELS)
+			table[v]++;
+	} else if (m < s) {
+		v = (t - 1) / 2 + 1; // f < v
+		table[0]++;
+		if (v < FEATURE_LEVELS)
+			table[v]--;
+	}
+}
+
+void build_votes(model_t *model)
+{
+	unsigned i;
+
+	for (i = 0; i < FEATURE_LEVELS; ++i) {
+		votes.mean[i] = 0;
+		votes.sd[i] = 0;
+	}
+	for (i = 0; i < MODEL_SIZE; ++i) {
+		add_votes(votes.mean, model->stationary[i].meanmag,
+				model->moving[i].meanmag);
+		add_votes(votes.sd, model->stationary[i].stddevmag,
+				model->moving[i].stddevmag);
+	}
+	for (i = 1; i < FEATURE_LEVELS; ++i) {
+		votes.mean[i] += votes.mean[i - 1];
+		votes.sd[i] += votes.sd[i - 1];
+	}
+}
+
+static inline unsigned feature_level(unsigned f)
+{
+	return f < FEATURE_LEVELS ? f : FEATURE_LEVELS - 1;
+}
+
+class_t classify_table(features_t *features)
+{
+	// Out of 2 * MODEL_SIZE votes, the rest go to stationary
+	unsigned move_less_error = votes.mean[feature_level(features->meanmag)] +
+		votes.sd[feature_level(features->stddevmag)];
+
+	class_t class = move_less_error > MODEL_SIZE ?
+		CLASS_MOVING : CLASS_STATIONARY;
+	LOG("classify: class %u\r\n", class);
+
+	return class;
+}
+
+#ifdef BENCH
+// Time from boot to the first classification. The state is set on every
+// boot, before restore_regs(), and moved on through a volatile pointer
+// so that the pass sees no WAR (as in fail.h). Timer_B0 counts from
+// init(); a boot that trains first takes longer than it can span, so
+// the time is only reported for boots that reuse the model.
+#define BOOT_IDLE    0
+#define BOOT_FRESH   1 // booted, no classification yet
+#define BOOT_TRAINED 2 // and trained since
+
+__nv unsigned boot_state = BOOT_IDLE;
+
+static inline void boot_set(unsigned state)
+{
+	*(volatile unsigned *)&boot_state = state;
+}
+
+static inline void boot_trained()
+{
+	if (*(volatile unsigned *)&boot_state == BOOT_FRESH)
+		boot_set(BOOT_TRAINED);
+}
+
+static void boot_classified()
+{
+	unsigned state = *(volatile unsigned *)&boot_state;
+
+	if (state == BOOT_FRESH)
+		PRINTF("boot: first classification after %lu cycles\r\n",
+				(unsigned long)bench_elapsed(0));
+	else if (state == BOOT_TRAINED)
+		PRINTF("boot: first classification after training\r\n");
+	boot_set(BOOT_IDLE);
+}
+
+#define BOOT_MARK() boot_set(BOOT_FRESH)
+
+// Cycles of the build_votes() for the current model
+__nv uint32_t votes_build = 0;
+
+// Cycles per classification of both methods on the same features
+typedef struct {
+	uint32_t scan;
+	uint32_t table;
+	uint32_t build;
+	uint32_t window; // featurize, classify and record, per window
+	unsigned mismatches;
+} classify_bench_t;
+
+static void bench_classify(classify_bench_t *b, features_t *features,
+		model_t *model)
+{
+	bench_t start;
+	class_t scan, table;
+
+	start = bench_start();
+	scan = classify_scan(features, model);
+	b->scan += bench_elapsed(start);
+
+	start = bench_start();
+	table = classify_table(features);
+	b->table += bench_elapsed(start);
+
+	b->mismatches += scan != table;
+}
+#else // !BENCH
+static inline void boot_trained() {}
+
+#define BOOT_MARK()
+#endif // BENCH
+
 void record_stats(stats_t *stats, class_t class)
 {
 	/* stats->totalCount, stats->movingCount, and stats->stationaryCount have an
 	 * nv-internal consistency requirement.  This code should be atomic. */
 
+	RATCHET_ATOMIC_BEGIN();
+	RATCHET_ATOMIC_LOG(stats->totalCount);
 	stats->totalCount++;
 
 	switch (class) {
 		case CLASS_MOVING:
 
+			RATCHET_ATOMIC_LOG(stats->movingCount);
 			stats->movingCount++;
 			break;
 
 		case CLASS_STATIONARY:
 
+			RATCHET_ATOMIC_LOG(stats->stationaryCount);
 			stats->stationaryCount++;
 			break;
 	}
+	RATCHET_ATOMIC_END();
 
 	LOG("stats: s %u m %u t %u\r\n",
 			stats->stationaryCount, stats->movingCount, stats->totalCount);
@@ -283,18 +721,31 @@ void warmup_sensor()
 	}
 }
 
+bool model_ready()
+{
+	return model_mark.valid == MODEL_VALID &&
+		model_mark.version == MODEL_VERSION;
+}
+
+static bool retrain_due()
+{
+#if RETRAIN_EVERY
+	return experiments % RETRAIN_EVERY == 0;
+#else
+	return false;
+#endif
+}
+
 void train(features_t *classModel)
 {
-	accelWindow sampleWindow;
 	features_t features;
 	unsigned i;
 
 	warmup_sensor();
+	features_begin();
 
 	for (i = 0; i < MODEL_SIZE; ++i) {
-		acquire_window(sampleWindow);
-		transform(sampleWindow);
-		featurize(&features, sampleWindow);
+		next_features(&features);
 
 		classModel[i] = features;
 	}
@@ -303,27 +754,82 @@ void train(features_t *classModel)
 	//          features.meanmag, features.stddevmag);
 }
 
+// The votes table is built once per model, before it is marked valid, and
+// whatever CLASSIFY_METHOD, so that a model kept across reflashing has one
+static void finish_model()
+{
+#ifdef BENCH
+	bench_t start = bench_start();
+#endif
+	build_votes(&model);
+#ifdef BENCH
+	votes_build = bench_elapsed(start);
+#endif
+	model_mark.valid = MODEL_VALID;
+}
+
+void train_class(class_t class)
+{
+	model_mark.valid = 0;
+	if (model_mark.version != MODEL_VERSION) {
+		model_mark.trained = 0;
+		model_mark.version = MODEL_VERSION;
+	}
+	model_mark.trained &= ~(1 << class);
+	boot_trained();
+
+	train(class == CLASS_MOVING ? model.moving : model.stationary);
+
+	model_mark.trained |= 1 << class;
+	if (model_mark.trained == ((1 << CLASS_STATIONARY) | (1 << CLASS_MOVING)))
+		finish_model();
+}
+
 void recognize(model_t *model)
 {
 	stats_t stats;
-	accelWindow sampleWindow;
 	features_t features;
 	class_t class;
 	unsigned i;
+#ifdef BENCH
+	classify_bench_t b = { 0, 0, 0, 0, 0 };
+	bench_t start;
+
+	b.build = votes_build;
+#endif
 
 	stats.totalCount = 0;
 	stats.stationaryCount = 0;
 	stats.movingCount = 0;
+	features_begin();
 
 	for (i = 0; i < SAMPLES_TO_COLLECT; ++i) {
-		acquire_window(sampleWindow);
-		transform(sampleWindow);
-		featurize(&features, sampleWindow);
-		class = classify(&features, model);
+#ifdef BENCH
+		start = bench_start();
+#endif
+		next_features(&features);
+#if CLASSIFY_METHOD == 1
+		class = classify_table(&features);
+#else
+		class = classify_scan(&features, model);
+#endif
 		record_stats(&stats, class);
+#ifdef BENCH
+		b.window += bench_elapsed(start);
+		boot_classified();
+		bench_classify(&b, &features, model);
+#endif
 	}
 
 	print_stats(&stats);
+	BENCH_PRINTF("bench: classify %u entries: scan %lu, table %lu cycles/call, "
+			"build %lu cycles, %u mismatches\r\n", MODEL_SIZE,
+			(unsigned long)(b.scan / SAMPLES_TO_COLLECT),
+			(unsigned long)(b.table / SAMPLES_TO_COLLECT),
+			(unsigned long)b.build, b.mismatches);
+	BENCH_PRINTF("bench: window %u stride %u: %lu classifications/Mcycle\r\n",
+			ACCEL_WINDOW_SIZE, ACCEL_WINDOW_STRIDE,
+			1000000ul / (b.window / SAMPLES_TO_COLLECT));
 }
 
 run_mode_t select_mode(uint8_t *prev_pin_state)
@@ -332,14 +838,20 @@ run_mode_t select_mode(uint8_t *prev_pin_state)
 
 	count++;
 	LOG("count: %u\r\n", count);
+	// The pins ask for training only when there is no model for this build,
+	// or when retraining is due; otherwise recognition starts right away
+	if (count == 1 && model_ready() && !retrain_due())
+		count = 3;
 	if(count >= 2) pin_state = 2;
 	if(count >= 3) pin_state = 0;
 	if(count >= 4) {   
+		TRACE_SITE(TRACE_SITE_ITER_END);
 		PRINTF("end\r\n");
 		GPIO(PORT_AUX3, OUT) |= BIT(PIN_AUX_3);
 		GPIO(PORT_AUX3, OUT) &= ~BIT(PIN_AUX_3);
 		count = 0;
 		seed = 1;
+		experiments++;
 		*prev_pin_state = MODE_IDLE;
 		pin_state = 99;
 	}
@@ -405,15 +917,19 @@ int main()
 	// init() and restore_regs() should be called at the beginning of main.
 	// I could have made the compiler to do that, but was a bit lazy..
 	init();
+	TRACE_BOOT();
+	PROF_BOOT();
+	BOOT_MARK();
+	RATCHET_ATOMIC_BOOT();
 	restore_regs();
+	TRACE_START();
 
 	uint8_t prev_pin_state = MODE_IDLE;
 
-	model_t model;
-
 	while (1)
 	{
 		if (count == 0) {
+			TRACE_SITE(TRACE_SITE_ITER_BEGIN);
 			GPIO(PORT_AUX, OUT) |= BIT(PIN_AUX_1);
 			GPIO(PORT_AUX, OUT) &= ~BIT(PIN_AUX_1);
 			PRINTF("start\r\n");
@@ -422,14 +938,19 @@ int main()
 		switch (mode) {
 			case MODE_TRAIN_STATIONARY:
 				LOG("mode: stationary\r\n");
-				train(model.stationary);
+				train_class(CLASS_STATIONARY);
 				break;
 			case MODE_TRAIN_MOVING:
 				LOG("mode: moving\r\n");
-				train(model.moving);
+				train_class(CLASS_MOVING);
 				break;
 			case MODE_RECOGNIZE:
 				LOG("mode: recognize\r\n");
+				// A failure cut training short: the next experiment trains
+				if (!model_ready()) {
+					PRINTF("recognize: no model\r\n");
+					break;
+				}
 				recognize(&model);
 				break;
 			default:
@@ -35,8 +35,17 @@
 #include <libratchet/ratchet.h>
 #endif
 #include "pins.h"
+#include "trace.h"
+#include "prof.h"
+#include "bench.h"
+
+// Inputs are SEED, SEED + 13, ... for ITER calls per variant
+#ifndef SEED
 #define SEED 4L
+#endif
+#ifndef ITER
 #define ITER 100
+#endif
 #define CHAR_BIT 8
 
 static const char bc_bits[256] =
@@ -64,6 +73,7 @@ static void init_hw()
 	msp_watchdog_disable();
 	msp_gpio_unlock();
 	msp_clock_setup();
+	bench_init();
 }
 
 void init()
@@ -100,7 +110,7 @@ void init()
 #endif
 }
 
-unsigned bit_count(uint32_t x)
+int bit_count(uint32_t x)
 {
 	unsigned n = 0;
 	/*
@@ -177,83 +187,133 @@ static int bit_shifter(uint32_t x)
 		n += (int)(x & 1L);
 	return n;
 }
+// Sum of the bits of a 16-bit word, in parallel within the word; on the
+// 16-bit core every step is one or two register instructions, where the
+// 32-bit bitcount() shifts and masks register pairs
+static unsigned bitcount16(uint16_t w)
+{
+	w = w - ((w >> 1) & 0x5555);
+	w = (w & 0x3333) + ((w >> 2) & 0x3333);
+	w = (w + (w >> 4)) & 0x0f0f;
+	return (w + (w >> 8)) & 0x1f;
+}
+int word_bitcount(uint32_t x)
+{
+	return bitcount16((uint16_t)x) + bitcount16((uint16_t)(x >> 16));
+}
+
+// bc_bits[] on the bytes of the two 16-bit halves: no 32-bit shifts, and
+// the halves stay in registers where the union and pointer variants above
+// go through memory
+int btbl16_bitcount(uint32_t x)
+{
+	uint16_t lo = (uint16_t)x;
+	uint16_t hi = (uint16_t)(x >> 16);
+
+	return bc_bits[lo & 0xff] + bc_bits[lo >> 8] +
+		bc_bits[hi & 0xff] + bc_bits[hi >> 8];
+}
+
+// Reference count, one bit at a time
+static int bc_ref(uint32_t x)
+{
+	int n = 0;
+
+	for (; x; x >>= 1)
+		n += x & 1;
+	return n;
+}
+
+typedef struct {
+	const char *name;
+	int (*count)(uint32_t x);
+} bc_variant_t;
+
+static const bc_variant_t bc_variants[] = {
+	{ "bit_count",        bit_count },
+	{ "bitcount",         bitcount },
+	{ "ntbl_bitcnt",      ntbl_bitcnt },
+	{ "ntbl_bitcount",    ntbl_bitcount },
+	{ "BW_btbl_bitcount", BW_btbl_bitcount },
+	{ "AR_btbl_bitcount", AR_btbl_bitcount },
+	{ "bit_shifter",      bit_shifter },
+	{ "word_bitcount",    word_bitcount },
+	{ "btbl16_bitcount",  btbl16_bitcount },
+};
+#define BC_VARIANTS (sizeof(bc_variants) / sizeof(bc_variants[0]))
+
+typedef struct {
+	unsigned bits;   // sum of the counts
+	unsigned errors; // calls that disagree with bc_ref()
+	uint32_t cycles; // 0 without BENCH
+} bc_result_t;
+
+// ITER calls of one variant. Each call is timed on its own, so the span
+// stays within what bench.h can measure whatever ITER is; the cycles
+// include the call and return.
+static void bc_run(const bc_variant_t *v, bc_result_t *r)
+{
+	uint32_t seed = (uint32_t)SEED;
+	unsigned iter;
+	bench_t start;
+	int n;
+
+	r->bits = 0;
+	r->errors = 0;
+	r->cycles = 0;
+	for (iter = 0; iter < ITER; ++iter, seed += 13) {
+		start = bench_start();
+		n = v->count(seed);
+		r->cycles += bench_elapsed(start);
+		r->bits += n;
+		if (n != bc_ref(seed))
+			++r->errors;
+	}
+}
+
 int main()
 {
 	// init() and restore_regs() should be called at the beginning of main.
 	// I could have made the compiler to do that, but was a bit lazy..
 	init();
+	TRACE_BOOT();
+	PROF_BOOT();
 	restore_regs();
+	TRACE_START();
 
-	unsigned n_0, n_1, n_2, n_3, n_4, n_5, n_6;
-	uint32_t seed;
-	unsigned iter;
+	bc_result_t results[BC_VARIANTS];
 	unsigned func;
 
 	while (1) {
+		TRACE_SITE(TRACE_SITE_ITER_BEGIN);
 #ifdef LOGIC
 		// Out high
 		GPIO(PORT_AUX, OUT) |= BIT(PIN_AUX_1);
 		// Out low
 		GPIO(PORT_AUX, OUT) &= ~BIT(PIN_AUX_1);
 #endif
-		n_0=0;
-		n_1=0;
-		n_2=0;
-		n_3=0;
-		n_4=0;
-		n_5=0;
-		n_6=0;
 		PRINTF("start\r\n");
-		for (func = 0; func < 7; func++) {
+		for (func = 0; func < BC_VARIANTS; func++) {
 			LOG("func: %u\r\n", func);
-			seed = (uint32_t)SEED;
-			if(func == 0){
-				for(iter = 0; iter < ITER; ++iter, seed += 13){
-					n_0 += bit_count(seed);
-				}
-			}
-			else if(func == 1){
-				for(iter = 0; iter < ITER; ++iter, seed += 13){
-					n_1 += bitcount(seed);
-				}
-			}
-			else if(func == 2){
-				for(iter = 0; iter < ITER; ++iter, seed += 13){
-					n_2 += ntbl_bitcnt(seed);
-				}
-			}
-			else if(func == 3){
-				for(iter = 0; iter < ITER; ++iter, seed += 13){
-					n_3 += ntbl_bitcount(seed);
-				}
-			}
-			else if(func == 4){
-				for(iter = 0; iter < ITER; ++iter, seed += 13){
-					n_4 += BW_btbl_bitcount(seed);
-				}
-			}
-			else if(func == 5){
-				for(iter = 0; iter < ITER; ++iter, seed += 13){
-					n_5 += AR_btbl_bitcount(seed);
-				}
-			}
-			else if(func == 6){
-				for(iter = 0; iter < ITER; ++iter, seed += 13){
-					n_6 += bit_shifter(seed);
-				}
-			}
+			bc_run(&bc_variants[func], &results[func]);
 		}
 
 		PRINTF("end\r\n");
 		BLOCK_PRINTF_BEGIN();
-		BLOCK_PRINTF("%u\r\n", n_0);
-		BLOCK_PRINTF("%u\r\n", n_1);
-		BLOCK_PRINTF("%u\r\n", n_2);
-		BLOCK_PRINTF("%u\r\n", n_3);
-		BLOCK_PRINTF("%u\r\n", n_4);
-		BLOCK_PRINTF("%u\r\n", n_5);
-		BLOCK_PRINTF("%u\r\n", n_6);
+		for (func = 0; func < BC_VARIANTS; func++)
+			BLOCK_PRINTF("%u\r\n", results[func].bits);
 		BLOCK_PRINTF_END();
+		for (func = 0; func < BC_VARIANTS; func++) {
+			if (results[func].errors)
+				PRINTF("%s: %u errors\r\n", bc_variants[func].name,
+						results[func].errors);
+		}
+		for (func = 0; func < BC_VARIANTS; func++) {
+			BENCH_PRINTF("bench: %s %lu cycles/call\r\n",
+					bc_variants[func].name,
+					(unsigned long)(results[func].cycles / ITER));
+		}
+		TRACE_SITE(TRACE_SITE_ITER_END);
 #ifdef LOGIC
 		GPIO(PORT_AUX3, OUT) |= BIT(PIN_AUX_3);
 		GPIO(PORT_AUX3, OUT) &= ~BIT(PIN_AUX_3);
@@ -36,6 +36,15 @@
 #endif
 
 #include "pins.h"
+#include "trace.h"
+#include "prof.h"
+
+#define BENCH_SHIFT 6 // a cold key (521 BF_encrypt calls) takes ~2^21 cycles
+#include "bench.h"
+#include "fail.h"
+#include "atomic.h"
+#include "chkpt.h"
+
 #define LENGTH 13
 
 static void init_hw()
@@ -61,6 +70,21 @@ static __ro_nv const uint32_t init_key[18] = {
 
 __nv uint32_t s0[256], s1[256], s2[256], s3[256];
 
+// The expanded key: the P-array here and the S-boxes in s0..s3, kept across
+// iterations and reboots and redone only when the key changes. It is
+// tagged with the key it came from (all 16 bytes, compared exactly: as
+// cheap as a digest, and never a false hit) and trusted only while valid
+// is set. set_key() clears valid before writing any of the schedule and
+// sets it last, so a reboot mid-expansion leaves no half-written schedule
+// in use, only a cold key on the next call.
+typedef struct {
+	uint32_t p[18];
+	unsigned char key[16];
+	bool valid; // commit marker
+} key_schedule_t;
+
+__nv key_schedule_t schedule;
+
 __ro_nv static const uint32_t init_s0[256] = {
 	0xd1310ba6L, 0x98dfb5acL, 0x2ffd72dbL, 0xd01adfb7L, 
 	0xb8e1afedL, 0x6a267e96L, 0xba7c9045L, 0xf12c7f99L, 
@@ -342,6 +366,7 @@ void init()
 	init_hw();
 
 	INIT_CONSOLE();
+	bench_init();
 
 	__enable_interrupt();
 #ifdef LOGIC
@@ -371,7 +396,60 @@ void init()
 #endif
 }
 
-void BF_encrypt(uint32_t *data, uint32_t *key){
+// The round function on 16-bit words. The S-box indices are the bytes of
+// the 32-bit halves, read directly instead of shifted out (a 32-bit shift
+// is a multi-instruction sequence or a helper call on MSP430, and there
+// are four per round), and the 16 rounds are unrolled, alternating the
+// halves instead of swapping them. Same output as BF_encrypt_loop().
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ != __ORDER_LITTLE_ENDIAN__
+#error BF_encrypt() reads the bytes of a word little-endian
+#endif
+
+typedef union {
+	uint32_t w;
+	uint8_t b[4]; // b[3] is the most significant
+} bf_half_t;
+
+#define BF_F(x) \
+	(((s0[(x).b[3]] + s1[(x).b[2]]) ^ s2[(x).b[1]]) + s3[(x).b[0]])
+#define BF_ROUND(x, y, i) ((y).w ^= key[i] ^ BF_F(x))
+
+// Inlined even at -O0, for the atomic region of bf_stream_block()
+#define BF_INLINE static inline __attribute__((always_inline))
+
+BF_INLINE void bf_rounds(uint32_t *data, uint32_t *key)
+{
+	bf_half_t a, b;
+
+	a.w = data[0] ^ key[0];
+	b.w = data[1];
+	BF_ROUND(a, b, 1);
+	BF_ROUND(b, a, 2);
+	BF_ROUND(a, b, 3);
+	BF_ROUND(b, a, 4);
+	BF_ROUND(a, b, 5);
+	BF_ROUND(b, a, 6);
+	BF_ROUND(a, b, 7);
+	BF_ROUND(b, a, 8);
+	BF_ROUND(a, b, 9);
+	BF_ROUND(b, a, 10);
+	BF_ROUND(a, b, 11);
+	BF_ROUND(b, a, 12);
+	BF_ROUND(a, b, 13);
+	BF_ROUND(b, a, 14);
+	BF_ROUND(a, b, 15);
+	BF_ROUND(b, a, 16);
+	data[1] = a.w;
+	data[0] = b.w ^ key[17];
+}
+
+void BF_encrypt(uint32_t *data, uint32_t *key)
+{
+	bf_rounds(data, key);
+}
+
+// The original rounds, with shifts, kept to compare against (BENCH)
+void BF_encrypt_loop(uint32_t *data, uint32_t *key){
 	uint32_t l, r, p, s0_t, s1_t, s2_t, s3_t, tmp;
 	r = data[0];
 	l = data[1];
@@ -402,7 +480,7 @@ void BF_encrypt(uint32_t *data, uint32_t *key){
 	data[1] = r;
 	data[0] = l;
 }
-void BF_set_key(unsigned char *data, uint32_t *key){
+void BF_set_key(const unsigned char *data, uint32_t *key){
 	unsigned i;
 	uint32_t ri, ri2;
 	unsigned d = 0;
@@ -511,6 +589,35 @@ void BF_set_key(unsigned char *data, uint32_t *key){
 		}
 	}
 }
+// Expands ukey into schedule, unless that is the key it already holds.
+// Returns true if it had to (a cold key).
+bool set_key(const unsigned char *ukey)
+{
+	unsigned i;
+
+	if (schedule.valid) {
+		for (i = 0; i < 16 && schedule.key[i] == ukey[i]; ++i)
+			;
+		if (i == 16)
+			return false;
+	}
+
+	schedule.valid = false;
+	for (i = 0; i < 18; ++i)
+		schedule.p[i] = init_key[i];
+	for (i = 0; i < 256; ++i) {
+		s0[i] = init_s0[i];
+		s1[i] = init_s1[i];
+		s2[i] = init_s2[i];
+		s3[i] = init_s3[i];
+	}
+	BF_set_key(ukey, schedule.p);
+	for (i = 0; i < 16; ++i)
+		schedule.key[i] = ukey[i];
+	schedule.valid = true; // commit
+	return true;
+}
+
 //#if OPTED == 1
 //void BF_cfb64_encrypt(unsigned char* out, unsigned char* iv){
 //#else
@@ -562,7 +669,7 @@ void BF_cfb64_encrypt(unsigned char* out, unsigned char* iv, uint32_t *key){
 		}
 		c= indata[i]^iv[n];
 		out[i]=c;
-#if ENERGY == 0
+#if ENERGY == 0 && !defined(BENCH)
 		PRINTF("result: %x\r\n", c);
 #endif
 		iv[n]=c;
@@ -570,19 +677,272 @@ void BF_cfb64_encrypt(unsigned char* out, unsigned char* iv, uint32_t *key){
 	}
 }
 
+// Streaming encryption over caller buffers, block by block.
+//
+// The stream state lives in FRAM with a cursor of committed 8-byte blocks.
+// Block i is computed from in[] and the chaining value (IV, previous
+// cyphertext block or counter) v[i & 1] only; the next chaining value goes
+// to the other copy, and then bumping the cursor (one word) commits both.
+// Each block is an atomic region: as it writes nothing it reads, a block
+// cut short by a failure is redone whole from committed state, without an
+// undo log, and a fresh start resumes at the first uncommitted block. out[] must not
+// overlap in[]. ECB and CBC zero-pad a trailing partial block and write it
+// whole (out[] takes len rounded up to 8); CFB64 and CTR write len bytes.
+#define BF_BLOCK 8
+
+#define BF_ECB   0
+#define BF_CBC   1
+#define BF_CFB64 2 // as BF_cfb64_encrypt(): the cyphertext feeds back
+#define BF_CTR   3 // big-endian 64-bit counter, starting at the IV
+#define BF_MODES 4
+
+static const char *const bf_mode_name[BF_MODES] = { "ecb", "cbc", "cfb64", "ctr" };
+
+typedef struct {
+	unsigned mode;
+	unsigned len;                 // bytes in the stream
+	unsigned block;               // blocks committed to out[]: the cursor
+	unsigned begun;               // blocks begun, including redone ones
+	unsigned char v[2][BF_BLOCK]; // chaining value for block i in v[i & 1]
+	bool active;                  // started and not finished
+} bf_stream_t;
+
+// BF_encrypt() on 8 bytes, big-endian as in BF_cfb64_encrypt()
+BF_INLINE void bf_encrypt_block(unsigned char *b, uint32_t *key)
+{
+	uint32_t ti[2];
+	unsigned j;
+
+	ti[0] = ti[1] = 0;
+	for (j = 0; j < 4; ++j) {
+		ti[0] = (ti[0] << 8) | b[j];
+		ti[1] = (ti[1] << 8) | b[j + 4];
+	}
+	bf_rounds(ti, key);
+	for (j = 4; j-- > 0;) {
+		b[j] = ti[0] & 0xff;
+		b[j + 4] = ti[1] & 0xff;
+		ti[0] >>= 8;
+		ti[1] >>= 8;
+	}
+}
+
+void bf_stream_start(bf_stream_t *st, unsigned mode, const unsigned char *iv,
+		unsigned len)
+{
+	unsigned j;
+
+	st->mode = mode;
+	st->len = len;
+	st->block = 0;
+	st->begun = 0;
+	for (j = 0; j < BF_BLOCK; ++j)
+		st->v[0][j] = iv[j];
+	st->active = true; // commit
+}
+
+void bf_stream_block(bf_stream_t *st, const unsigned char *in,
+		unsigned char *out, uint32_t *key)
+{
+	unsigned i = st->block;
+	unsigned offset = i * BF_BLOCK;
+	unsigned n = (st->len - offset < BF_BLOCK) ? st->len - offset : BF_BLOCK;
+	const unsigned char *v = st->v[i & 1];
+	unsigned char *next = st->v[(i + 1) & 1];
+	unsigned char x[BF_BLOCK];
+	unsigned j, c;
+
+	RATCHET_ATOMIC_BEGIN();
+	(*(volatile unsigned *)&st->begun)++; // not rolled back
+
+	for (j = 0; j < BF_BLOCK; ++j) {
+		if (st->mode == BF_ECB)
+			x[j] = (j < n) ? in[offset + j] : 0;
+		else if (st->mode == BF_CBC)
+			x[j] = ((j < n) ? in[offset + j] : 0) ^ v[j];
+		else
+			x[j] = v[j];
+	}
+	bf_encrypt_block(x, key);
+
+	if (st->mode == BF_ECB || st->mode == BF_CBC) {
+		for (j = 0; j < BF_BLOCK; ++j) {
+			out[offset + j] = x[j];
+			next[j] = x[j];
+		}
+	} else {
+		// x is the keystream
+		for (j = 0; j < n; ++j) {
+			x[j] ^= in[offset + j];
+			out[offset + j] = x[j];
+			next[j] = x[j];
+		}
+		if (st->mode == BF_CTR) {
+			c = 1;
+			for (j = BF_BLOCK; j-- > 0;) {
+				c += v[j];
+				next[j] = c & 0xff;
+				c >>= 8;
+			}
+		}
+	}
+
+	st->block = i + 1; // commit
+	RATCHET_ATOMIC_END();
+}
+
+// Runs the stream to its end, from its cursor on
+void bf_stream_run(bf_stream_t *st, const unsigned char *in,
+		unsigned char *out, uint32_t *key)
+{
+	while (st->block * BF_BLOCK < st->len)
+		bf_stream_block(st, in, out, key);
+	st->active = false;
+}
+
+// The sensor log encrypted every iteration, STREAM_BYTES of it, in buffers
+// of STREAM_MAX in FRAM
+#ifndef STREAM_MAX
+#define STREAM_MAX 8192
+#endif
+#ifndef STREAM_BYTES
+#define STREAM_BYTES 1024
+#endif
+#ifndef STREAM_MODE
+#define STREAM_MODE BF_CTR
+#endif
+
+#if STREAM_BYTES > STREAM_MAX || STREAM_MAX > 16384
+#error STREAM_BYTES must not exceed STREAM_MAX, nor that 16384
+#endif
+
+__nv unsigned char log_in[STREAM_MAX];
+__nv unsigned char log_out[STREAM_MAX];
+__nv bf_stream_t stream;
+
+static __ro_nv const unsigned char stream_iv[BF_BLOCK] = {
+	0xfe, 0xdc, 0xba, 0x98, 0x76, 0x54, 0x32, 0x10
+};
+
+// A slow ramp with LFSR noise in the low bits, like a sampled sensor
+void fill_log(unsigned char *log, unsigned len)
+{
+	uint16_t lfsr = 0xace1;
+	unsigned i;
+
+	for (i = 0; i < len; ++i) {
+		lfsr = (lfsr >> 1) ^ (-(lfsr & 1) & 0xb400);
+		log[i] = ((i >> 4) + (lfsr & 0x7)) & 0xff;
+	}
+}
+
+#ifdef BENCH
+// Key set-up and encryption of the LENGTH bytes, per byte: with the key
+// expanded first (cold), then cached (warm)
+void bench_keys(const unsigned char *ukey)
+{
+	unsigned char out[LENGTH], iv[8];
+	unsigned pass, i;
+	bench_t start;
+	uint32_t cycles;
+	bool cold;
+
+	for (pass = 0; pass < 2; ++pass) {
+		if (pass == 0)
+			schedule.valid = false;
+		for (i = 0; i < 8; ++i)
+			iv[i] = 0;
+
+		start = bench_start();
+		cold = set_key(ukey);
+		BF_cfb64_encrypt(out, iv, schedule.p);
+		cycles = bench_elapsed(start);
+
+		PRINTF("bench: %s key: %lu cycles, %lu cycles/byte\r\n",
+				cold ? "cold" : "warm", (unsigned long)cycles,
+				(unsigned long)(cycles / LENGTH));
+	}
+}
+
+// Cycles per block of BF_encrypt() against BF_encrypt_loop(), over the
+// log, with the outputs checked against each other
+#define BENCH_ROUND_BLOCKS 64
+
+void bench_rounds()
+{
+	uint32_t x[2], y[2];
+	uint32_t unrolled = 0, loop = 0;
+	unsigned i, j, mismatches = 0;
+	bench_t start;
+
+	fill_log(log_in, BENCH_ROUND_BLOCKS * BF_BLOCK);
+	for (i = 0; i < BENCH_ROUND_BLOCKS; ++i) {
+		x[0] = x[1] = 0;
+		for (j = 0; j < 4; ++j) {
+			x[0] = (x[0] << 8) | log_in[i * BF_BLOCK + j];
+			x[1] = (x[1] << 8) | log_in[i * BF_BLOCK + j + 4];
+		}
+		y[0] = x[0];
+		y[1] = x[1];
+
+		start = bench_start();
+		BF_encrypt(x, schedule.p);
+		unrolled += bench_elapsed(start);
+		start = bench_start();
+		BF_encrypt_loop(y, schedule.p);
+		loop += bench_elapsed(start);
+
+		mismatches += x[0] != y[0] || x[1] != y[1];
+	}
+	PRINTF("bench: BF_encrypt %lu, loop %lu cycles/block, %u mismatches\r\n",
+			(unsigned long)(unrolled / BENCH_ROUND_BLOCKS),
+			(unsigned long)(loop / BENCH_ROUND_BLOCKS), mismatches);
+}
+
+// Throughput of each mode, in bytes per million cycles, over buffers of 64
+// B up to STREAM_MAX. Blocks are timed one at a time, to stay within the
+// span bench.h can measure.
+void bench_stream()
+{
+	bf_stream_t st;
+	unsigned mode, len;
+	uint32_t cycles;
+	bench_t start;
+
+	fill_log(log_in, STREAM_MAX);
+	for (mode = 0; mode < BF_MODES; ++mode) {
+		for (len = 64; len <= STREAM_MAX; len *= 2) {
+			bf_stream_start(&st, mode, stream_iv, len);
+			cycles = 0;
+			while (st.block * BF_BLOCK < st.len) {
+				start = bench_start();
+				bf_stream_block(&st, log_in, log_out, schedule.p);
+				cycles += bench_elapsed(start);
+			}
+			PRINTF("bench: %s %u B: %lu B/Mcycle\r\n", bf_mode_name[mode],
+					len, (unsigned long)((uint64_t)len * 1000000 / cycles));
+		}
+	}
+}
+#endif
 
 int main()
 {
 	// init() and restore_regs() should be called at the beginning of main.
 	// I could have made the compiler to do that, but was a bit lazy..
 	init();
+	TRACE_BOOT();
+	PROF_BOOT();
+	FAIL_BOOT();
+	RATCHET_ATOMIC_BOOT();
 	restore_regs();
+	TRACE_START();
 
-	uint32_t key[18];
 	unsigned char ukey[16];
 	unsigned char indata[40], outdata[40], ivec[8];
 
 	while (1) {
+		TRACE_SITE(TRACE_SITE_ITER_BEGIN);
 #ifdef LOGIC
 		GPIO(PORT_AUX, OUT) |= BIT(PIN_AUX_1);
 		GPIO(PORT_AUX, OUT) &= ~BIT(PIN_AUX_1);
@@ -609,24 +969,38 @@ int main()
 			}
 
 		}
-		for (i = 0; i < 18; ++i)
-			key[i] = init_key[i];
-
-		for (i = 0; i < 1024; ++i) {
-			if (i == 0 || i == 256 || i == 256*2 || i == 256*3){
-			}
-			if (i < 256) 
-				s0[i] = init_s0[i];
-			else if (i < 256*2)
-				s1[i-256] = init_s1[i-256];
-			else if (i < 256*3)
-				s2[i-256*2] = init_s2[i-256*2];
-			else 
-				s3[i-256*3] = init_s3[i-256*3];
+		// Re-keys only if the key changed (or the last expansion was cut
+		// short); the schedule carries over from earlier iterations
+		set_key(ukey);
+		BF_cfb64_encrypt(outdata, ivec, schedule.p);
+
+		// The sensor log; a fresh start in the middle resumes at the first
+		// uncommitted block
+		if (!stream.active) {
+			fill_log(log_in, STREAM_BYTES);
+			fail_reset();
+			chkpt_reset();
+			bf_stream_start(&stream, STREAM_MODE, stream_iv, STREAM_BYTES);
 		}
-		BF_set_key(ukey, key);
-		BF_cfb64_encrypt(outdata, ivec, key);
+		bf_stream_run(&stream, log_in, log_out, schedule.p);
+
+		// Work lost to failures is the blocks run more than once
+		PRINTF("stream: %s %u B: %u blocks, %u redone, %u failures, %lu ticks\r\n",
+				bf_mode_name[STREAM_MODE], STREAM_BYTES, stream.block,
+				stream.begun - stream.block, fail_failures(),
+				(unsigned long)fail_elapsed());
+#ifdef CHKPT_COUNT
+		PRINTF("stream: %lu checkpoints, %lu/block\r\n",
+				(unsigned long)chkpt_count(),
+				(unsigned long)(chkpt_count() / stream.block));
+#endif
+#ifdef BENCH
+		bench_keys(ukey);
+		bench_rounds();
+		bench_stream();
+#endif
 		PRINTF("end\r\n");
+		TRACE_SITE(TRACE_SITE_ITER_END);
 #ifdef LOGIC
 		GPIO(PORT_AUX3, OUT) |= BIT(PIN_AUX_3);
 		GPIO(PORT_AUX3, OUT) &= ~BIT(PIN_AUX_3);
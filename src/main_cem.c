@@ -33,15 +33,50 @@
 #ifdef RATCHET
 #include <libratchet/ratchet.h>
 #endif
+#include "atomic.h"
 
 #include "pins.h"
+#include "trace.h"
+#include "prof.h"
+
+#define BENCH_SHIFT 4 // a whole block is timed as one span
+#include "bench.h"
 
 #define TEST_SAMPLE_DATA
 
+// Input: 0 = the (prev + 1) & 3 counter, 1 = the sensor-like trace in
+// cem_corpus.h (regenerate with ext/python_dissembler/cem_corpus.py)
+#ifndef SAMPLE_SOURCE
+#define SAMPLE_SOURCE 0
+#endif
+
 #define NIL 0 // like NULL, but for indexes, not real pointers
 
+#ifndef DICT_SIZE
 #define DICT_SIZE         512
+#endif
+#ifndef BLOCK_SIZE
 #define BLOCK_SIZE         64
+#endif
+
+// Child lookup: 1 = open-addressed (parent, letter) table, 0 = sibling lists
+#ifndef DICT_HASH
+#define DICT_HASH 1
+#endif
+
+// Either dictionary takes 6 bytes of FRAM per node. The FR5969 has 48 KB
+// below 64K for code and all data, so 8192 nodes cannot fit.
+#ifndef DICT_SIZE_MAX
+#define DICT_SIZE_MAX 4096
+#endif
+
+#if DICT_SIZE > DICT_SIZE_MAX
+#error DICT_SIZE does not fit in FRAM
+#endif
+
+#if DICT_HASH && (DICT_SIZE & (DICT_SIZE - 1))
+#error DICT_SIZE must be a power of 2 for the hashed dictionary
+#endif
 
 #define NUM_LETTERS_IN_SAMPLE        2
 #define LETTER_MASK             0x00FF
@@ -51,6 +86,31 @@ typedef unsigned index_t;
 typedef unsigned letter_t;
 typedef unsigned sample_t;
 // NOTE: can't use pointers, since need to ChSync, etc
+#if DICT_HASH
+#if LETTER_SIZE_BITS > 8
+#error The hashed dictionary stores letters in one byte
+#endif
+
+// Nodes exist only as table entries: root nodes are implicit (index ==
+// letter), and a child is found by its (parent, letter) key. An entry is
+// live only while it carries the dictionary's generation, so bumping the
+// generation empties the dictionary in O(1). Same NV footprint as the
+// sibling-list dictionary (6 bytes per node).
+typedef struct _entry_t {
+	index_t parent;
+	index_t child;  // node index, which is the code emitted for it
+	uint8_t letter;
+	uint8_t gen;
+} entry_t;
+
+// At most DICT_SIZE - NUM_LETTERS entries are live, so at least NUM_LETTERS
+// slots are always free and probing terminates.
+typedef struct _dict_t {
+	entry_t table[DICT_SIZE]; // (parent, letter) -> child, linear probing
+	unsigned node_count;
+	uint8_t gen; // never 0 once initialized; zeroed FRAM reads as empty
+} dict_t;
+#else
 typedef struct _node_t {
 	letter_t letter; // 'letter' of the alphabet
 	index_t sibling; // this node is a member of the parent's children list
@@ -61,11 +121,31 @@ typedef struct _dict_t {
 	node_t nodes[DICT_SIZE];
 	unsigned node_count;
 } dict_t;
+#endif
+
+// Codes are bit-packed LSB first, each as wide as the dictionary is at the
+// time it is emitted (see code_width), so the decoder can follow along.
+#if DICT_SIZE <= 512
+#define CODE_MAX_BITS  9
+#elif DICT_SIZE <= 1024
+#define CODE_MAX_BITS 10
+#elif DICT_SIZE <= 2048
+#define CODE_MAX_BITS 11
+#elif DICT_SIZE <= 4096
+#define CODE_MAX_BITS 12
+#elif DICT_SIZE <= 8192
+#define CODE_MAX_BITS 13
+#else
+#define CODE_MAX_BITS 16
+#endif
+#define LOG_WORDS ((BLOCK_SIZE * CODE_MAX_BITS + 15) / 16 + 1)
 
 typedef struct _log_t {
-	index_t data[BLOCK_SIZE];
-	unsigned count;
+	uint16_t data[LOG_WORDS];
+	unsigned count;        // codes in the block
 	unsigned sample_count;
+	unsigned bit_count;    // bits written to data
+	uint16_t pending;      // bits already in data[bit_count / 16]
 } log_t;
 
 void print_log(log_t *log)
@@ -73,17 +153,20 @@ void print_log(log_t *log)
 	unsigned i;
 	PRINTF("rate: samples/block: %u/%u\r\n",
 			log->sample_count, log->count);
-	//	BLOCK_PRINTF("compressed block:\r\n");
-	//	for (i = 0; __loop_bound__(64),i < log->count; ++i) {
-	//
-	//		BLOCK_PRINTF("%04x ", log->data[i]);
-	//		if (i > 0 && ((i + 1) & (8 - 1)) == 0){
-	//		}
-	//		BLOCK_PRINTF("\r\n");
-	//	}
-	//	if ((log->count & (8 - 1)) != 0){
-	//	}
-	//	BLOCK_PRINTF("\r\n");
+#if VERBOSE > 0
+	unsigned words = (log->bit_count + 15) >> 4;
+
+	BLOCK_PRINTF_BEGIN();
+	BLOCK_PRINTF("compressed block: %u bits\r\n", log->bit_count);
+	for (i = 0; i < words; ++i) {
+		BLOCK_PRINTF("%04x ", log->data[i]);
+		if (((i + 1) & (8 - 1)) == 0)
+			BLOCK_PRINTF("\r\n");
+	}
+	if ((words & (8 - 1)) != 0)
+		BLOCK_PRINTF("\r\n");
+	BLOCK_PRINTF_END();
+#endif
 }
 
 static void init_hw()
@@ -92,13 +175,99 @@ static void init_hw()
 	msp_gpio_unlock();
 	msp_clock_setup();
 }
-sample_t acquire_sample(letter_t prev_sample)
+
+#if SAMPLE_SOURCE == 1
+#include "cem_corpus.h" // CEM_CORPUS_LEN, CEM_CORPUS_INIT
+
+#if CEM_CORPUS_LEN & (CEM_CORPUS_LEN - 1)
+#error CEM_CORPUS_LEN must be a power of 2
+#endif
+
+__ro_nv const sample_t corpus[CEM_CORPUS_LEN] = CEM_CORPUS_INIT;
+#endif
+
+sample_t acquire_sample(unsigned sample_idx, sample_t prev_sample)
 {
+#if SAMPLE_SOURCE == 1
+	return corpus[sample_idx & (CEM_CORPUS_LEN - 1)];
+#else
 	//letter_t sample = rand() & 0x0F;
 	letter_t sample = (prev_sample + 1) & 0x03;
 	return sample;
+#endif
+}
+
+#if DICT_HASH
+static index_t hash_slot(letter_t letter, index_t parent)
+{
+	// parent * 131, without a multiply, with the letter in the top bits:
+	// added to the low bits, the children of nearby parents fall into one
+	// run of slots, which linear probing grows into a long cluster
+	return (((parent << 7) + (parent << 1) + parent) ^
+		(letter * (DICT_SIZE / NUM_LETTERS))) & (DICT_SIZE - 1);
+}
+
+static index_t find_slot(letter_t letter, index_t parent, dict_t *dict)
+{
+	index_t slot = hash_slot(letter, parent);
+	entry_t *entry = &dict->table[slot];
+
+	while (entry->gen == dict->gen) {
+		if (entry->parent == parent && entry->letter == letter)
+			break;
+		slot = (slot + 1) & (DICT_SIZE - 1);
+		entry = &dict->table[slot];
+	}
+	return slot;
+}
+
+void init_dict(dict_t *dict)
+{
+	LOG("init dict\r\n");
+
+	dict->gen++;
+	if (dict->gen == 0) {
+		// Wrapped: entries from 255 blocks ago would look live again.
+		// This is the only reset that touches the table.
+		unsigned i;
+		for (i = 0; i < DICT_SIZE; ++i)
+			dict->table[i].gen = 0;
+		dict->gen = 1;
+	}
+	dict->node_count = NUM_LETTERS;
 }
 
+index_t find_child(letter_t letter, index_t parent, dict_t *dict)
+{
+	entry_t *entry = &dict->table[find_slot(letter, parent, dict)];
+	index_t child = (entry->gen == dict->gen) ? entry->child : NIL;
+
+	LOG("find child: l %u p %u c %u\r\n", letter, parent, child);
+	return child;
+}
+
+void add_node(letter_t letter, index_t parent, dict_t *dict)
+{
+	if (dict->node_count == DICT_SIZE) {
+#if ENERGY == 0
+		PRINTF("add node: table full\r\n");
+#endif
+		return;
+	}
+
+	index_t node_index = dict->node_count;
+	entry_t *entry = &dict->table[find_slot(letter, parent, dict)];
+
+	LOG("add node: i %u l %u, p: %u\r\n", node_index, letter, parent);
+
+	// Fill the entry before the generation stamp makes it live
+	entry->parent = parent;
+	entry->letter = letter;
+	entry->child = node_index;
+	entry->gen = dict->gen;
+	dict->node_count++;
+}
+#else
 void init_dict(dict_t *dict)
 {
 	letter_t l;
@@ -153,7 +322,7 @@ void add_node(letter_t letter, index_t parent, dict_t *dict)
 #if ENERGY == 0
 		PRINTF("add node: table full\r\n");
 #endif
-		//while(1); // bail for now
+		return;
 	}
 	// Initialize the new node
 	node_t *node = &dict->nodes[dict->node_count];
@@ -190,11 +359,65 @@ void add_node(letter_t letter, index_t parent, dict_t *dict)
 		dict->nodes[parent].child = node_index;
 	}
 }
+#endif
+
+// Bits needed for any code below node_count (which is >= NUM_LETTERS)
+static unsigned code_width(unsigned node_count)
+{
+	unsigned width = LETTER_SIZE_BITS;
+
+	while ((1u << width) < node_count)
+		++width;
+	return width;
+}
 
-void append_compressed(index_t parent, log_t *log)
+void append_compressed(index_t parent, unsigned node_count, log_t *log)
 {
+	unsigned width = code_width(node_count);
+	unsigned word = log->bit_count >> 4;
+	unsigned offset = log->bit_count & 0xf;
+
 	LOG("append comp: p %u cnt %u\r\n", parent, log->count);
-	log->data[log->count++] = parent;
+
+	// The partially filled word is rebuilt from 'pending' and written
+	// whole, never read back, so data[] carries no WAR and re-running an
+	// append after a restore just rewrites the same words. 'pending',
+	// 'bit_count' and 'count' must move together: one atomic region,
+	// with no checkpoint between them.
+	RATCHET_ATOMIC_BEGIN();
+	uint16_t low = log->pending | (parent << offset);
+
+	log->data[word] = low;
+	RATCHET_ATOMIC_LOG(log->pending);
+	if (offset + width >= 16) {
+		uint16_t high = offset ? parent >> (16 - offset) : 0;
+
+		log->data[word + 1] = high;
+		log->pending = high;
+	} else {
+		log->pending = low;
+	}
+	RATCHET_ATOMIC_LOG(log->bit_count);
+	log->bit_count += width;
+	RATCHET_ATOMIC_LOG(log->count);
+	log->count++;
+	RATCHET_ATOMIC_END();
+}
+
+// Letters are one byte each (LETTER_SIZE_BITS), so letters in = bytes in
+void print_bench(log_t *log, uint32_t block_cycles)
+{
+#ifdef BENCH
+	unsigned bytes_in = log->sample_count - 1; // last letter starts next block
+	unsigned bytes_out = (log->bit_count + 7) >> 3;
+	unsigned ratio = (uint32_t)bytes_in * 100 / bytes_out;
+
+	PRINTF("bench: dict %u hash %u: %lu cycles/block\r\n",
+			DICT_SIZE, DICT_HASH, (unsigned long)block_cycles);
+	PRINTF("bench: %u B in, %u B out, ratio %u.%02u, %lu cycles/B\r\n",
+			bytes_in, bytes_out, ratio / 100, ratio % 100,
+			(unsigned long)(block_cycles / bytes_in));
+#endif
 }
 
 void init()
@@ -202,6 +425,7 @@ void init()
 	init_hw();
 
 	INIT_CONSOLE();
+	bench_init();
 
 	__enable_interrupt();
 #ifdef LOGIC
@@ -236,50 +460,60 @@ int main()
 	// init() and restore_regs() should be called at the beginning of main.
 	// I could have made the compiler to do that, but was a bit lazy..
 	init();
+	TRACE_BOOT();
+	PROF_BOOT();
+	RATCHET_ATOMIC_BOOT();
 	restore_regs();
+	TRACE_START();
 	static __nv dict_t dict;
 	static __nv log_t log;
+
+	// Assume all streams start with a fixed prefix ('0'), to avoid having
+	// to letterize this out-of-band sample. After that, the letter that
+	// ended each block starts the next one, so no input is dropped.
+	letter_t letter = 0;
+
+	unsigned letter_idx = 0;
+	unsigned sample_idx = 0;
+	sample_t sample, prev_sample = 0;
 	// test
 	while (1) {
+		TRACE_SITE(TRACE_SITE_ITER_BEGIN);
 #ifdef LOGIC
 		// Out high
 		GPIO(PORT_AUX, OUT) |= BIT(PIN_AUX_1);
 		// Out low
 		GPIO(PORT_AUX, OUT) &= ~BIT(PIN_AUX_1);
 #endif
+		bench_t block_start = bench_start();
+
 		init_dict(&dict);
 		// Initialize the pointer into the dictionary to one of the root nodes
-		// Assume all streams start with a fixed prefix ('0'), to avoid having
-		// to letterize this out-of-band sample.
-		letter_t letter = 0;
-
-		unsigned letter_idx = 0;
 		index_t parent, child;
-		sample_t sample, prev_sample = 0;
 
-		log.sample_count = 1; // count the initial sample (see above)
+		log.sample_count = 1; // count the initial letter (see above)
 		log.count = 0; // init compressed counter
+		log.bit_count = 0;
+		log.pending = 0;
 
 		while (1) {
 
 			child = (index_t)letter; // relyes on initialization of dict
 			LOG("compress: parent %u\r\n", child); // naming is odd due to loop
 
-			if (letter_idx == 0) {
-				sample = acquire_sample(prev_sample);
-				prev_sample = sample;
-			}
-			LOG("letter index: %u\r\n", letter_idx);
-			//PRINTF("letter index: %u\r\n", letter_idx);
-			letter_idx++;
-			if (letter_idx == NUM_LETTERS_IN_SAMPLE)
-				letter_idx = 0;
 			do {
-				//PRINTF("child before: %u\r\n", child);
-				unsigned letter_idx_tmp = (letter_idx == 0) ? NUM_LETTERS_IN_SAMPLE : letter_idx - 1; 
-
-				unsigned letter_shift = LETTER_SIZE_BITS * letter_idx_tmp;
-				letter = (sample & (LETTER_MASK << letter_shift)) >> letter_shift;
+				// Every step consumes the next letter of the input
+				if (letter_idx == 0) {
+					sample = acquire_sample(sample_idx++, prev_sample);
+					prev_sample = sample;
+				}
+				LOG("letter index: %u\r\n", letter_idx);
+				//PRINTF("letter index: %u\r\n", letter_idx);
+				unsigned letter_shift = LETTER_SIZE_BITS * letter_idx;
+				letter = (sample >> letter_shift) & LETTER_MASK;
+				letter_idx++;
+				if (letter_idx == NUM_LETTERS_IN_SAMPLE)
+					letter_idx = 0;
 				LOG("letterize: sample %x letter %x (%u)\r\n",
 						sample, letter, letter);
 				//PRINTF("letterize: sample %x letter %x (%u)\r\n",
@@ -292,17 +526,21 @@ int main()
 				LOG("child: %u\r\n", child);
 			} while (child != NIL);
 
-			append_compressed(parent, &log);
+			append_compressed(parent, dict.node_count, &log);
 			add_node(letter, parent, &dict);
 
 			if (log.count == BLOCK_SIZE) {
+				uint32_t block_cycles = bench_elapsed(block_start);
+
 				print_log(&log);
+				print_bench(&log, block_cycles);
 				log.count = 0;
 				log.sample_count = 0;
 
 				break;
 			}
 		}
+		TRACE_SITE(TRACE_SITE_ITER_END);
 #ifdef LOGIC
 		GPIO(PORT_AUX3, OUT) |= BIT(PIN_AUX_3);
 		GPIO(PORT_AUX3, OUT) &= ~BIT(PIN_AUX_3);
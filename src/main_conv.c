@@ -33,6 +33,14 @@
 #include <libratchet/ratchet.h>
 #include "param.h"
 #include "pins.h"
+#include "trace.h"
+#include "prof.h"
+
+#define BENCH_SHIFT 4 // a chunk of naive outputs takes ~100k cycles
+#include "bench.h"
+#include "conv.h"
+#include "fail.h"
+#include "chkpt.h"
 
 static void init_hw()
 {
@@ -49,6 +57,7 @@ void init()
 #endif
 
 	INIT_CONSOLE();
+	bench_init();
 
 	__enable_interrupt();
 #ifdef RATCHET
@@ -77,25 +86,111 @@ void init()
 	}
 }
 
+// vec[] and out[] (and out_ref[], out_bench[] with BENCH) take 2 bytes of
+// FRAM per sample each: N of a few thousand fits next to the code.
+#ifndef N
 #define N 500
+#endif
+#ifndef K
 #define K 20
+#endif
+
+// CONV_NAIVE, CONV_BOX (the kernel is all ones) or CONV_FIR; see conv.h.
+// The output is computed in tiles of CONV_TILE (conv.h, 0 for no tiling).
+#ifndef CONV_METHOD
+#define CONV_METHOD CONV_BOX
+#endif
+
+#if K > CONV_K_MAX
+#error K is longer than conv_fir takes
+#endif
+
+#if defined(RATCHET) && CONV_TILE == 0 && CONV_METHOD == CONV_FIR
+#error conv_fir keeps its delay line in SRAM and needs CONV_TILE > 0
+#endif
+
 // This is to avoid arrays ending up
 // in .bss (for Ratchet)
 __nv unsigned vec[N];
-const unsigned kernel[K] =
-{1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
-	1, 1, 1, 1, 1, 1, 1, 1, 1, 1
+const unsigned kernel[CONV_K_MAX] =
+{1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+	1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+	1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+	1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1
 };
 __nv unsigned out[N-K+1];
+__nv conv_progress_t progress;
+
+#ifdef BENCH
+#define BENCH_CHUNK 64 // outputs per timed span
+
+__nv unsigned out_ref[N];
+__nv unsigned out_bench[N]; // out[] is too short for k < K
+
+static const unsigned bench_k[] = {5, 8, 16, 20, 32, 64};
+
+// Cycles per output of one method over all of vec[], timed in chunks. Each
+// chunk is an atomic region, as a tile of conv_tiled() is, which conv_fir
+// needs for its delay line in SRAM; so no method is timed with the pass's
+// checkpoints in its loops, and all with the region's two per chunk.
+static uint32_t bench_conv(unsigned method, unsigned k, unsigned *dst)
+{
+	unsigned n_out = N - k + 1;
+	uint32_t cycles = 0;
+
+	for (unsigned i = 0; i < n_out; i += BENCH_CHUNK) {
+		unsigned len = (n_out - i < BENCH_CHUNK) ? n_out - i : BENCH_CHUNK;
+		bench_t start = bench_start();
+
+		RATCHET_ATOMIC_BEGIN();
+		conv_run(method, &vec[i], &dst[i], len, kernel, k);
+		RATCHET_ATOMIC_END();
+		cycles += bench_elapsed(start);
+	}
+	return cycles / n_out;
+}
+
+// Every method at every kernel length, checked against the naive one
+static void bench_sweep()
+{
+	for (unsigned t = 0; t < sizeof(bench_k) / sizeof(bench_k[0]); ++t) {
+		unsigned k = bench_k[t];
+
+		if (k > N)
+			break;
+
+		unsigned n_out = N - k + 1;
+		unsigned mismatches = 0;
+
+		uint32_t naive = bench_conv(CONV_NAIVE, k, out_ref);
+		uint32_t box = bench_conv(CONV_BOX, k, out_bench);
+		for (unsigned i = 0; i < n_out; ++i)
+			mismatches += out_bench[i] != out_ref[i];
+		uint32_t fir = bench_conv(CONV_FIR, k, out_bench);
+		for (unsigned i = 0; i < n_out; ++i)
+			mismatches += out_bench[i] != out_ref[i];
+
+		PRINTF("bench: N %u K %u: naive %lu box %lu fir %lu cycles/out, "
+				"%u mismatches\r\n", N, k, (unsigned long)naive,
+				(unsigned long)box, (unsigned long)fir, mismatches);
+	}
+}
+#endif
 
 int main()
 {
 	// init() and restore_regs() should be called at the beginning of main.
 	// I could have made the compiler to do that, but was a bit lazy..
 	init();
+	TRACE_BOOT();
+	PROF_BOOT();
+	FAIL_BOOT();
+	RATCHET_ATOMIC_BOOT();
 	restore_regs();
+	TRACE_START();
 
 	while (1) {
+		TRACE_SITE(TRACE_SITE_ITER_BEGIN);
 #ifdef LOGIC
 		// Out high
 		GPIO(PORT_AUX, OUT) |= BIT(PIN_AUX_1);
@@ -106,18 +201,35 @@ int main()
 		PRINTF("start\r\n");
 #endif
 
-		// init vec
-		for (unsigned i = 0; i < N; ++i)
-			vec[i] = i;
+		// A fresh start in the middle of a run resumes it at the first
+		// uncommitted tile; only a new run sets up the input.
+		if (progress.started == 0) {
+			// init vec
+			for (unsigned i = 0; i < N; ++i)
+				vec[i] = i;
+			fail_reset();
+			chkpt_reset();
+		}
+
+		// Convolution: K window LPF
+#if CONV_TILE > 0
+		conv_tiled(CONV_METHOD, vec, out, N-K+1, kernel, K, &progress);
 
-		// init out
-		for (unsigned i = 0; i < N-K+1; ++i)
-			out[i] = 0;
+		// Work lost to failures is the tiles run more than once
+		PRINTF("conv: tile %u: %u tiles, %u redone, %u failures, %lu ticks\r\n",
+				CONV_TILE, progress.tile, progress.started - progress.tile,
+				fail_failures(), (unsigned long)fail_elapsed());
+		progress.tile = 0;
+		progress.started = 0;
+#else
+		conv_run(CONV_METHOD, vec, out, N-K+1, kernel, K);
 
-		// Convolution: 5 window LPF
-		for (unsigned i = 0; i < N-K+1; ++i)
-			for (unsigned j = 0; j < K; ++j)
-				out[i] += vec[i+j]*kernel[K-(j+1)];
+		PRINTF("conv: %u failures, %lu ticks\r\n",
+				fail_failures(), (unsigned long)fail_elapsed());
+#endif
+#ifdef CHKPT_COUNT
+		PRINTF("conv: %lu checkpoints\r\n", (unsigned long)chkpt_count());
+#endif
 
 #ifdef CONFIG_EDB
 		BLOCK_PRINTF_BEGIN();
@@ -135,6 +247,10 @@ int main()
 #ifndef RATCHET
 		unsigned tmp = curctx->cur_reg[15];
 #endif
+#endif
+		TRACE_SITE(TRACE_SITE_ITER_END);
+#ifdef BENCH
+		bench_sweep();
 #endif
 		end_run();
 	}
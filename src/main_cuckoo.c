@@ -40,20 +40,156 @@
 
 
 #include "pins.h"
+#include "trace.h"
+#include "prof.h"
+#include "bench.h"
+#include "fail.h"
+#include "atomic.h"
+#include "chkpt.h"
 
 #include <stdint.h>
 
-#define NUM_BUCKETS 128 // must be a power of 2
-#define MAX_RELOCATIONS 8
+#ifndef NUM_BUCKETS
+#define NUM_BUCKETS 32 // must be a power of 2
+#endif
+#ifndef BUCKET_SLOTS
+#define BUCKET_SLOTS 4 // fingerprints per bucket: 1, 2 or 4
+#endif
+#ifndef FP_BITS
+#define FP_BITS 16 // 8, 12 or 16
+#endif
+#ifndef MAX_RELOCATIONS
+#define MAX_RELOCATIONS 64
+#endif
 
-#define NUM_KEYS (NUM_BUCKETS / 4) // shoot for 25% occupancy
+#define NUM_SLOTS (NUM_BUCKETS * BUCKET_SLOTS)
+#ifndef LOAD_PCT
+#define LOAD_PCT 95 // keys inserted, in percent of NUM_SLOTS
+#endif
+#define NUM_KEYS ((unsigned)((uint32_t)NUM_SLOTS * LOAD_PCT / 100))
 #define INIT_KEY 0x1
 
+// Around the insert phase of each round: with TRACE=1, trace_decode.py
+// reports its latency and the reboots it took
+#define TRACE_SITE_INSERT_BEGIN (TRACE_SITE_USER + 0)
+#define TRACE_SITE_INSERT_END   (TRACE_SITE_USER + 1)
+
+// 1 = fingerprint and bucket from one hardware multiply, 0 = a byte-wise
+// djb hash per derived value and libc rand()
+#ifndef HASH_MULTIPLY
+#define HASH_MULTIPLY 1
+#endif
+
+#if NUM_BUCKETS & (NUM_BUCKETS - 1)
+#error NUM_BUCKETS must be a power of 2
+#endif
+#if BUCKET_SLOTS != 1 && BUCKET_SLOTS != 2 && BUCKET_SLOTS != 4
+#error BUCKET_SLOTS must be 1, 2 or 4
+#endif
+
 typedef uint16_t value_t;
 typedef uint16_t hash_t;
-typedef uint16_t fingerprint_t;
+typedef uint16_t fingerprint_t; // 0 marks an empty slot
 typedef uint16_t index_t; // bucket index
 
+#if FP_BITS == 12
+#if BUCKET_SLOTS != 4
+#error 12-bit fingerprints are packed four to a bucket
+#endif
+
+// Slots 0..2 sit in the low 12 bits of w[0..2], slot 3 in their top nibbles.
+// set_fp() is inlined even at -O0, as apply() calls it in an atomic region.
+typedef struct _bucket_t {
+	uint16_t w[3];
+} bucket_t;
+
+static fingerprint_t get_fp(bucket_t *bucket, unsigned slot)
+{
+	if (slot < 3)
+		return bucket->w[slot] & 0x0fff;
+	return (bucket->w[0] >> 12) | ((bucket->w[1] >> 8) & 0x00f0) |
+		((bucket->w[2] >> 4) & 0x0f00);
+}
+
+static inline __attribute__((always_inline))
+void set_fp(bucket_t *bucket, unsigned slot, fingerprint_t fp)
+{
+	if (slot < 3) {
+		bucket->w[slot] = (bucket->w[slot] & 0xf000) | fp;
+	} else {
+		bucket->w[0] = (bucket->w[0] & 0x0fff) | ((unsigned)fp << 12);
+		bucket->w[1] = (bucket->w[1] & 0x0fff) | (((unsigned)fp << 8) & 0xf000);
+		bucket->w[2] = (bucket->w[2] & 0x0fff) | (((unsigned)fp << 4) & 0xf000);
+	}
+}
+#else
+#if FP_BITS == 8
+typedef uint8_t slot_t;
+#elif FP_BITS == 16
+typedef uint16_t slot_t;
+#else
+#error FP_BITS must be 8, 12 or 16
+#endif
+
+// set_fp() is inlined even at -O0, as apply() calls it in an atomic region
+typedef struct _bucket_t {
+	slot_t fp[BUCKET_SLOTS];
+} bucket_t;
+
+static fingerprint_t get_fp(bucket_t *bucket, unsigned slot)
+{
+	return bucket->fp[slot];
+}
+
+static inline __attribute__((always_inline))
+void set_fp(bucket_t *bucket, unsigned slot, fingerprint_t fp)
+{
+	bucket->fp[slot] = fp;
+}
+#endif
+
+// When a relocation chain runs out, the fingerprint left in hand is parked
+// in 'victim' instead of being dropped, so the filter never gives a false
+// negative. Once the victim is taken, inserts that need to relocate fail.
+//
+// 'ops' counts the operations applied, for the caller to resume by: every
+// insert() and delete() commits exactly once, changing the filter or not,
+// so a fresh start neither repeats nor skips one.
+typedef struct _filter_t {
+	bucket_t buckets[NUM_BUCKETS];
+	fingerprint_t victim; // 0 if none
+	index_t victim_index; // either of the victim's buckets
+	unsigned count;       // fingerprints stored, victim included
+	unsigned ops;         // operations applied since ops_rewind()
+} filter_t;
+
+// Redo log. The filter is only ever written by applying a committed log:
+// an operation first plans all of its slot writes and the new victim and
+// count into the log, reading the filter but not writing it, then sets
+// 'committed', copies the log into the filter and clears 'committed'.
+// Every entry holds an absolute value, so applying a log again is harmless:
+// a change cut short by a power failure is either invisible (not committed
+// yet) or finished by replaying the log, at boot or by re-execution.
+typedef struct _redo_entry_t {
+	index_t bucket;
+	unsigned slot;
+	fingerprint_t fp;
+} redo_entry_t;
+
+typedef struct _redo_log_t {
+	redo_entry_t entry[MAX_RELOCATIONS + 1]; // a chain plus its final insert
+	unsigned len;
+	fingerprint_t victim;
+	index_t victim_index;
+	unsigned count;
+	unsigned ops;
+	bool committed;
+} redo_log_t;
+
+// Runs of apply() since the round began: one per operation, plus one for
+// each run a power failure cut short
+__nv unsigned apply_runs = 0;
+
 static void init_hw()
 {
 	msp_watchdog_disable();
@@ -61,25 +197,28 @@ static void init_hw()
 	msp_clock_setup();
 }
 
-void print_filter(fingerprint_t *filter)
+void print_filter(filter_t *filter)
 {
 	unsigned i;
 	BLOCK_PRINTF_BEGIN();
-	for (i = 0; i < NUM_BUCKETS; ++i) {
-		BLOCK_PRINTF("%04x ", filter[i]);
+	for (i = 0; i < NUM_SLOTS; ++i) {
+		BLOCK_PRINTF("%04x ", get_fp(&filter->buckets[i / BUCKET_SLOTS],
+					i & (BUCKET_SLOTS - 1)));
 		if (i > 0 && (i + 1) % 8 == 0){
 			BLOCK_PRINTF("\r\n");
 		}
 	}
+	BLOCK_PRINTF("victim: %04x\r\n", filter->victim);
 	BLOCK_PRINTF_END();
 }
-void log_filter(fingerprint_t *filter)
+void log_filter(filter_t *filter)
 {
 	unsigned i;
 	BLOCK_LOG_BEGIN();
 	BLOCK_LOG("address: %x\r\n", filter);
-	for (i = 0; i < NUM_BUCKETS; ++i) {
-		BLOCK_LOG("%04x ", filter[i]);
+	for (i = 0; i < NUM_SLOTS; ++i) {
+		BLOCK_LOG("%04x ", get_fp(&filter->buckets[i / BUCKET_SLOTS],
+					i & (BUCKET_SLOTS - 1)));
 		if (i > 0 && (i + 1) % 8 == 0)
 			BLOCK_LOG("\r\n");
 	}
@@ -92,6 +231,62 @@ void print_stats(unsigned inserts, unsigned members, unsigned total)
 			inserts, members, total);
 }
 
+void print_load(unsigned inserts, unsigned false_positives, unsigned max_chain)
+{
+	unsigned load = (uint32_t)inserts * 1000 / NUM_SLOTS;
+
+	PRINTF("load: buckets %u slots %u fp %u bits: %u.%u%% full, "
+			"false positives %u/%u, longest chain %u\r\n",
+			NUM_BUCKETS, BUCKET_SLOTS, FP_BITS, load / 10, load % 10,
+			false_positives, NUM_KEYS, max_chain);
+}
+
+void print_delete(unsigned deletes, unsigned left)
+{
+	PRINTF("delete: %u keys, %u left\r\n", deletes, left);
+}
+
+void print_bench(uint32_t insert_cycles, uint32_t lookup_cycles,
+		uint32_t delete_cycles, unsigned deletes)
+{
+	BENCH_PRINTF("bench: insert %lu lookup %lu delete %lu cycles/op\r\n",
+			(unsigned long)(insert_cycles / NUM_KEYS),
+			(unsigned long)(lookup_cycles / NUM_KEYS),
+			(unsigned long)(deletes ? delete_cycles / deletes : 0));
+}
+
+__nv uint16_t rand_state = 1;
+
+#if HASH_MULTIPLY
+#define HASH_KEY_MULT 0x9e37 // odd, 2^16 / golden ratio
+#define HASH_FP_MULT  0x5bd1 // odd
+
+// Multiply-shift: one hardware multiply yields both values. The low half of
+// the product is a one-to-one map of the key (the multiplier is odd), so
+// 16-bit fingerprints never collide; the high half picks the bucket.
+static void hash_key(value_t key, fingerprint_t *fp, index_t *index)
+{
+	uint32_t hash = mult16(key, HASH_KEY_MULT);
+	fingerprint_t f = (uint16_t)hash >> (16 - FP_BITS);
+
+	*fp = f ? f : 1; // 0 is the empty slot
+	*index = (uint16_t)(hash >> 16) & (NUM_BUCKETS - 1);
+}
+
+static index_t hash_fp_to_index(fingerprint_t fp)
+{
+	// Aligned to the top so that short fingerprints still reach the high half
+	uint32_t hash = mult16((unsigned)fp << (16 - FP_BITS), HASH_FP_MULT);
+	return (uint16_t)(hash >> 16) & (NUM_BUCKETS - 1);
+}
+
+// LCG on the hardware multiplier; only its high bits are used
+static uint16_t rand16(uint16_t *state)
+{
+	*state = (uint16_t)mult16(*state, 25173) + 13849;
+	return *state;
+}
+#else
 static hash_t djb_hash(uint8_t* data, unsigned len)
 {
 	uint32_t hash = 5381;
@@ -118,9 +313,24 @@ static index_t hash_key_to_index(value_t fp)
 
 static fingerprint_t hash_to_fingerprint(value_t key)
 {
-	return djb_hash((uint8_t *)&key, sizeof(value_t));
+	// Top bits: the low ones of the same hash pick the primary bucket
+	hash_t hash = djb_hash((uint8_t *)&key, sizeof(value_t));
+	fingerprint_t fp = hash >> (16 - FP_BITS);
+	return fp ? fp : 1; // 0 is the empty slot
+}
+
+static void hash_key(value_t key, fingerprint_t *fp, index_t *index)
+{
+	*fp = hash_to_fingerprint(key);
+	*index = hash_key_to_index(key);
 }
 
+static uint16_t rand16(uint16_t *state)
+{
+	return (uint16_t)rand() << 1; // RAND_MAX is 0x7fff; state is unused
+}
+#endif
+
 static value_t generate_key(value_t prev_key)
 {
 	// insert pseufo-random integers, for testing
@@ -130,15 +340,134 @@ static value_t generate_key(value_t prev_key)
 	return (prev_key + 1) * 17;
 }
 
-static bool insert(fingerprint_t *filter, value_t key)
+static bool bucket_contains(bucket_t *bucket, fingerprint_t fp)
+{
+	unsigned slot;
+
+	for (slot = 0; slot < BUCKET_SLOTS; ++slot) {
+		if (get_fp(bucket, slot) == fp)
+			return true;
+	}
+	return false;
+}
+
+// Planning keeps the number of entries in a local, *len, and stores it in
+// the log once, in commit(): only the entries themselves are written to
+// FRAM per planned write.
+static void plan_begin(filter_t *filter, redo_log_t *redo)
+{
+	redo->victim = filter->victim;
+	redo->victim_index = filter->victim_index;
+	redo->count = filter->count;
+	redo->ops = filter->ops + 1;
+}
+
+// A slot as it will read once the planned writes are applied. A chain can
+// come back to a slot it already moved a fingerprint into.
+static fingerprint_t planned_fp(filter_t *filter, redo_log_t *redo,
+		unsigned len, index_t bucket, unsigned slot)
+{
+	unsigned i = len;
+
+	while (i--) {
+		redo_entry_t *entry = &redo->entry[i];
+		if (entry->bucket == bucket && entry->slot == slot)
+			return entry->fp;
+	}
+	return get_fp(&filter->buckets[bucket], slot);
+}
+
+static void plan_write(redo_log_t *redo, unsigned *len, index_t bucket,
+		unsigned slot, fingerprint_t fp)
 {
-	fingerprint_t fp1, fp2, fp_victim, fp_next_victim;
-	index_t index_victim, fp_hash_victim;
+	redo_entry_t *entry = &redo->entry[(*len)++];
+
+	entry->bucket = bucket;
+	entry->slot = slot;
+	entry->fp = fp;
+}
+
+// Plans to put fp into a free slot of the bucket, if it has one
+static bool plan_insert(filter_t *filter, redo_log_t *redo, unsigned *len,
+		index_t bucket, fingerprint_t fp)
+{
+	unsigned slot;
+
+	for (slot = 0; slot < BUCKET_SLOTS; ++slot) {
+		if (!planned_fp(filter, redo, *len, bucket, slot)) {
+			plan_write(redo, len, bucket, slot, fp);
+			return true;
+		}
+	}
+	return false;
+}
+
+static bool plan_remove(filter_t *filter, redo_log_t *redo, unsigned *len,
+		index_t bucket, fingerprint_t fp)
+{
+	unsigned slot;
+
+	for (slot = 0; slot < BUCKET_SLOTS; ++slot) {
+		if (planned_fp(filter, redo, *len, bucket, slot) == fp) {
+			plan_write(redo, len, bucket, slot, 0);
+			return true;
+		}
+	}
+	return false;
+}
+
+// Reads only the log and writes only the filter (and the commit flag), so a
+// run cut short by a power failure is simply run again: as an atomic region
+// it needs no undo log, and the pass's checkpoints in it, two or three per
+// fingerprint written (the loop counter, set_fp()'s return and, for packed
+// slots, the word it rewrites), give way to the two at its ends. apply_runs
+// is bumped out of the pass's sight, so it is not rolled back.
+static void apply(filter_t *filter, redo_log_t *redo)
+{
+	RATCHET_ATOMIC_BEGIN();
+	(*(volatile unsigned *)&apply_runs)++;
+	for (unsigned i = 0; i < redo->len; ++i) {
+		redo_entry_t *entry = &redo->entry[i];
+		set_fp(&filter->buckets[entry->bucket], entry->slot, entry->fp);
+	}
+	filter->victim = redo->victim;
+	filter->victim_index = redo->victim_index;
+	filter->count = redo->count;
+	filter->ops = redo->ops;
+	redo->committed = false;
+	RATCHET_ATOMIC_END();
+}
+
+// len: the entries planned
+static void commit(filter_t *filter, redo_log_t *redo, unsigned len)
+{
+	redo->len = len;
+	redo->committed = true;
+	apply(filter, redo);
+}
+
+// Finishes a change that was committed but not applied when power failed
+static void recover(filter_t *filter, redo_log_t *redo)
+{
+	if (redo->committed) {
+		LOG("recover: replay %u writes\r\n", redo->len);
+		apply(filter, redo);
+	}
+}
+
+// *chain is set to the number of fingerprints moved
+static bool insert(filter_t *filter, redo_log_t *redo, value_t key,
+		unsigned *chain)
+{
+	fingerprint_t fp_victim, fp_next_victim;
+	index_t index_victim;
 	unsigned relocation_count = 0;
+	unsigned len = 0;
 
-	fingerprint_t fp = hash_to_fingerprint(key);
+	fingerprint_t fp;
+	index_t index1;
 
-	index_t index1 = hash_key_to_index(key);
+	hash_key(key, &fp, &index1);
 
 	index_t fp_hash = hash_fp_to_index(fp);
 	index_t index2 = index1 ^ fp_hash;
@@ -146,67 +475,138 @@ static bool insert(fingerprint_t *filter, value_t key)
 	//PRINTF("insert: key %04x fp %04x h %04x i1 %u i2 %u\r\n",
 	//		key, fp, fp_hash, index1, index2);
 
-	fp1 = filter[index1];
-	//PRINTF("insert: fp1 %04x\r\n", fp1);
-	if (!fp1) { // slot 1 is free
-		filter[index1] = fp;
-	} else {
-		fp2 = filter[index2];
-		//PRINTF("insert: fp2 %04x\r\n", fp2);
-		if (!fp2) { // slot 2 is free
-			filter[index2] = fp;
-		} else { // both slots occupied, evict
-			if (rand() & 0x80) { // don't use lsb because it's systematic
-				index_victim = index1;
-				fp_victim = fp1;
-			} else {
-				index_victim = index2;
-				fp_victim = fp2;
-			}
+	*chain = 0;
+	plan_begin(filter, redo);
 
-			LOG("insert: evict [%u] = %04x\r\n", index_victim, fp_victim);
-			filter[index_victim] = fp; // evict victim
+	if (!plan_insert(filter, redo, &len, index1, fp) &&
+			!plan_insert(filter, redo, &len, index2, fp)) {
 
-			do { // relocate victim(s)
-				fp_hash_victim = hash_fp_to_index(fp_victim);
-				index_victim = index_victim ^ fp_hash_victim;
+		if (filter->victim) { // nowhere to put what a failed chain leaves over
+#if ENERGY == 0
+			PRINTF("insert: full, victim %04x\r\n", filter->victim);
+#endif
+			commit(filter, redo, 0); // only counts the operation
+			return false;
+		}
 
-				fp_next_victim = filter[index_victim];
-				filter[index_victim] = fp_victim;
+		// both buckets full, evict. rand_state is stepped once, here, so
+		// that an insert redone after a fresh start takes another chain;
+		// the chain draws from a local copy.
+		uint16_t rng = rand16(&rand_state);
+		index_victim = (rng & 0x8000) ? index1 : index2; // don't use lsb
+		fp_victim = fp;
 
-				//PRINTF("insert: moved %04x to %u; next victim %04x\r\n",
-				//		fp_victim, index_victim, fp_next_victim);
+		while (1) { // relocate victim(s)
+			unsigned slot = (rand16(&rng) >> 14) & (BUCKET_SLOTS - 1);
 
-				fp_victim = fp_next_victim;
-			} while (fp_victim && ++relocation_count < MAX_RELOCATIONS);
+			fp_next_victim = planned_fp(filter, redo, len, index_victim, slot);
+			plan_write(redo, &len, index_victim, slot, fp_victim);
+			fp_victim = fp_next_victim;
 
-			if (fp_victim) {
-#if ENERGY == 0
-				PRINTF("insert: lost fp %04x\r\n", fp_victim);
-#endif
-				return false;
+			LOG("insert: evict [%u.%u] = %04x\r\n",
+					index_victim, slot, fp_victim);
+
+			index_victim ^= hash_fp_to_index(fp_victim);
+			++relocation_count;
+
+			if (plan_insert(filter, redo, &len, index_victim, fp_victim))
+				break;
+
+			if (relocation_count == MAX_RELOCATIONS) {
+				LOG("insert: park victim %04x\r\n", fp_victim);
+				redo->victim = fp_victim;
+				redo->victim_index = index_victim;
+				break;
 			}
 		}
 	}
 
+	redo->count++;
+	commit(filter, redo, len);
+
+	*chain = relocation_count;
 	return true;
 }
 
-static bool lookup(fingerprint_t *filter, value_t key)
+static bool lookup(filter_t *filter, value_t key)
 {
-	fingerprint_t fp = hash_to_fingerprint(key);
+	fingerprint_t fp;
+	index_t index1;
 
-	index_t index1 = hash_key_to_index(key);
+	hash_key(key, &fp, &index1);
 
 	index_t fp_hash = hash_fp_to_index(fp);
 	index_t index2 = index1 ^ fp_hash;
 
 	LOG("lookup: key %04x fp %04x h %04x i1 %u i2 %u\r\n",
 			key, fp, fp_hash, index1, index2);
-	LOG("f[%u] %04x f[%u] %04x\r\n",
-			index1, filter[index1], index2, filter[index2]);
 
-	return filter[index1] == fp || filter[index2] == fp;
+	if (bucket_contains(&filter->buckets[index1], fp) ||
+			bucket_contains(&filter->buckets[index2], fp))
+		return true;
+
+	return filter->victim == fp &&
+		(filter->victim_index == index1 || filter->victim_index == index2);
+}
+
+// Only for keys that were inserted: a key that is not a member may share a
+// fingerprint and bucket with one that is, and would delete it.
+static bool delete(filter_t *filter, redo_log_t *redo, value_t key)
+{
+	fingerprint_t fp;
+	index_t index1;
+
+	hash_key(key, &fp, &index1);
+
+	index_t index2 = index1 ^ hash_fp_to_index(fp);
+	unsigned len = 0;
+
+	plan_begin(filter, redo);
+
+	if (!plan_remove(filter, redo, &len, index1, fp) &&
+			!plan_remove(filter, redo, &len, index2, fp)) {
+		if (filter->victim == fp && (filter->victim_index == index1 ||
+					filter->victim_index == index2)) {
+			redo->victim = 0;
+		} else {
+			LOG("delete: key %04x not found\r\n", key);
+			commit(filter, redo, 0); // only counts the operation
+			return false;
+		}
+	}
+
+	// A slot may have opened up for the parked victim
+	if (redo->victim) {
+		index_t index_alt = redo->victim_index ^ hash_fp_to_index(redo->victim);
+
+		if (plan_insert(filter, redo, &len, redo->victim_index, redo->victim) ||
+				plan_insert(filter, redo, &len, index_alt, redo->victim))
+			redo->victim = 0;
+	}
+
+	redo->count--;
+	commit(filter, redo, len);
+	return true;
+}
+
+// Counts an operation that leaves the filter as it is
+static void skip(filter_t *filter, redo_log_t *redo)
+{
+	plan_begin(filter, redo);
+	commit(filter, redo, 0);
+}
+
+// Back to 0 operations, for the next round
+static void ops_rewind(filter_t *filter, redo_log_t *redo)
+{
+	plan_begin(filter, redo);
+	redo->ops = 0;
+	commit(filter, redo, 0);
+}
+
+static unsigned count(filter_t *filter)
+{
+	return filter->count;
 }
 
 void init()
@@ -214,6 +614,7 @@ void init()
 	init_hw();
 
 	INIT_CONSOLE();
+	bench_init();
 
 	__enable_interrupt();
 #ifdef LOGIC
@@ -247,15 +648,36 @@ int main()
 	// init() and restore_regs() should be called at the beginning of main.
 	// I could have made the compiler to do that, but was a bit lazy..
 	init();
+	TRACE_BOOT();
+	PROF_BOOT();
+	FAIL_BOOT();
+	RATCHET_ATOMIC_BOOT();
 	restore_regs();
+	TRACE_START();
+
+	// The filter outlives power failures; only a fresh start gets here
+	static __nv filter_t filter;
+	static __nv redo_log_t redo;
 
-	fingerprint_t filter[NUM_BUCKETS];
+	recover(&filter, &redo);
 
 	unsigned i;
 	value_t key;
 
+	// A round inserts NUM_KEYS keys, then deletes them, one operation per
+	// key. A fresh start in the middle of one resumes it at the first
+	// operation not committed, with the keys the filter holds; the counts
+	// printed for that round only cover what ran after the fresh start.
+	if (filter.ops != 0) {
+#if ENERGY == 0
+		PRINTF("filter: resuming at op %u, %u keys\r\n",
+				filter.ops, count(&filter));
+#endif
+	}
+
 	//	unsigned count = 0;
 	while (1) {
+		TRACE_SITE(TRACE_SITE_ITER_BEGIN);
 #ifdef LOGIC
 		// Out high
 		GPIO(PORT_AUX, OUT) |= BIT(PIN_AUX_1);
@@ -267,14 +689,25 @@ int main()
 #if ENERGY == 0
 			PRINTF("start\r\n");
 #endif
-			for (i = 0; i < NUM_BUCKETS; ++i)
-				filter[i] = 0;
-
 			key = INIT_KEY;
 			unsigned inserts = 0;
+			unsigned chain, max_chain = 0;
+			uint32_t insert_cycles = 0;
+			if (filter.ops == 0) {
+				fail_reset();
+				chkpt_reset();
+				*(volatile unsigned *)&apply_runs = 0;
+			}
+			TRACE_SITE(TRACE_SITE_INSERT_BEGIN);
 			for (i = 0; i < NUM_KEYS; ++i) {
 				key = generate_key(key);
-				bool success = insert(filter, key);
+				if (i < filter.ops)
+					continue; // committed before a fresh start
+				bench_t op_start = bench_start();
+				bool success = insert(&filter, &redo, key, &chain);
+				insert_cycles += bench_elapsed(op_start);
+				if (chain > max_chain)
+					max_chain = chain;
 				LOG("insert: key %04x success %u\r\n", key, success);
 				if (!success) {
 #if ENERGY == 0
@@ -286,16 +719,47 @@ int main()
 				inserts += success;
 
 			}
+			TRACE_SITE(TRACE_SITE_INSERT_END);
 			LOG("inserts/total: %u/%u\r\n", inserts, NUM_KEYS);
 
+			// Resumed among the deletes: some members are gone already, so
+			// the lookups are skipped, and the inserts were reported
+			bool deleting = filter.ops > NUM_KEYS;
+
+			// Cost of the inserts under intermittent power: the on-time,
+			// the checkpoints and the applies run again
+			if (!deleting) {
+				uint32_t ticks = fail_elapsed();
+
+				PRINTF("insert: %u ops, %u redone, %u failures, "
+						"%lu ticks, %lu ticks/insert\r\n",
+						NUM_KEYS, *(volatile unsigned *)&apply_runs - NUM_KEYS,
+						fail_failures(), (unsigned long)ticks,
+						(unsigned long)(ticks / NUM_KEYS));
+#ifdef CHKPT_COUNT
+				uint32_t chkpts = chkpt_count();
+
+				PRINTF("insert: %lu checkpoints, %lu/insert\r\n",
+						(unsigned long)chkpts,
+						(unsigned long)(chkpts / NUM_KEYS));
+#endif
+			}
+
 			key = INIT_KEY;
 			unsigned members = 0;
+			uint32_t lookup_cycles = 0;
 			for (i = 0; i < NUM_KEYS; ++i) {
 				key = generate_key(key);
-				bool member = lookup(filter, key);
+				if (deleting)
+					continue;
+				bench_t op_start = bench_start();
+				bool member = lookup(&filter, key);
+				lookup_cycles += bench_elapsed(op_start);
 				LOG("lookup: key %04x member %u\r\n", key, member);
 				if (!member) {
-					fingerprint_t fp = hash_to_fingerprint(key);
+					fingerprint_t fp;
+					index_t index;
+					hash_key(key, &fp, &index);
 #if ENERGY == 0
 					PRINTF("lookup: key %04x fp %04x not member\r\n", key, fp);
 #endif
@@ -304,12 +768,43 @@ int main()
 			}
 			LOG("members/total: %u/%u\r\n", members, NUM_KEYS);
 
+			// The keys that follow in the sequence were never inserted
+			unsigned false_positives = 0;
+			for (i = 0; i < NUM_KEYS; ++i) {
+				key = generate_key(key);
+				if (!deleting)
+					false_positives += lookup(&filter, key);
+			}
+
+			// Empty the set for the next round, skipping keys whose insert
+			// failed (those that do not look up) so that they do not take
+			// out a colliding member.
+			key = INIT_KEY;
+			unsigned deletes = 0;
+			uint32_t delete_cycles = 0;
+			for (i = 0; i < NUM_KEYS; ++i) {
+				key = generate_key(key);
+				if (NUM_KEYS + i < filter.ops)
+					continue;
+				if (!lookup(&filter, key)) {
+					skip(&filter, &redo);
+					continue;
+				}
+				bench_t op_start = bench_start();
+				deletes += delete(&filter, &redo, key);
+				delete_cycles += bench_elapsed(op_start);
+			}
+			ops_rewind(&filter, &redo);
+
 			PRINTF("end\r\n");
-			//PRINTF("chkpt cnt: %u\r\n", chkpt_count);
 			//PRINTF(".%u.\r\n", curctx->cur_reg[15]);
-			//print_filter(filter);
+			//print_filter(&filter);
 			print_stats(inserts, members, NUM_KEYS);
+			print_load(inserts, false_positives, max_chain);
+			print_delete(deletes, count(&filter));
+			print_bench(insert_cycles, lookup_cycles, delete_cycles, deletes);
 		}
+		TRACE_SITE(TRACE_SITE_ITER_END);
 #ifdef LOGIC
 		GPIO(PORT_AUX3, OUT) |= BIT(PIN_AUX_3);
 		GPIO(PORT_AUX3, OUT) &= ~BIT(PIN_AUX_3);
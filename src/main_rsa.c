@@ -38,60 +38,243 @@
 #undef N // conflicts with us
 
 #include "pins.h"
-
+#include "trace.h"
+#include "prof.h"
+
+#define BENCH_SHIFT 6 // a 2048-bit mod_mult takes up to ~2^22 cycles
+#include "bench.h"
+#include "mac.h"
+#include "fail.h"
+#include "atomic.h"
+#include "chkpt.h"
+
+// 64, 256, 1024 or 2048, with the key in data/key<bits>.txt (see
+// ext/python_dissembler/rsa_key.py)
+#ifndef KEY_SIZE_BITS
 #define KEY_SIZE_BITS	256
-//#define KEY_SIZE_BITS	64
-#define DIGIT_BITS       8 // arithmetic ops take 8-bit args produce 16-bit result
-#define DIGIT_MASK       0x00ff
+#endif
+#define KEY_SIZE_BYTES   (KEY_SIZE_BITS / 8)
+
+// Arithmetic ops take DIGIT_BITS-bit args and produce a 2*DIGIT_BITS-bit
+// result: 8 (in int) or 16 (through the 16x16->32 hardware multiplier)
+#ifndef DIGIT_BITS
+#define DIGIT_BITS       16
+#endif
+#define DIGIT_BYTES      (DIGIT_BITS / 8)
+#define DIGIT_MASK       ((digit_t)(1UL << DIGIT_BITS) - 1)
 #define NUM_DIGITS       (KEY_SIZE_BITS / DIGIT_BITS)
 
+// How mod_mult() reduces each product modulo n
+#define REDUCE_DIVISION   0 // full product, then trial division per digit
+#define REDUCE_MONTGOMERY 1 // Montgomery multiplication, see mont_mult()
+
+#ifndef REDUCE_METHOD
+#define REDUCE_METHOD REDUCE_MONTGOMERY
+#endif
+
+// Products of at least this many digits are split by Karatsuba, recursively
+// down to this size (0 for schoolbook only)
+#ifndef KARATSUBA_THRESHOLD
+#define KARATSUBA_THRESHOLD 32
+#endif
+#define KARATSUBA_SCRATCH (4 * NUM_DIGITS + 32)
+
+// Exponents are scanned left to right in windows of up to this many bits,
+// each one multiplication by an odd power of the base from a table of
+// 2^(EXP_WINDOW-1) in FRAM (1 for plain square-and-multiply). Short
+// exponents get a narrower window, see exp_window().
+#ifndef EXP_WINDOW
+#define EXP_WINDOW 4
+#endif
+#define EXP_TABLE_SIZE (1 << (EXP_WINDOW - 1))
+
+// With the private key in data/key<bits>_priv.txt, also decrypt the
+// cyphertext back by CRT and check it against the plaintext
+#ifndef PRIVATE_KEY
+#define PRIVATE_KEY 0
+#endif
+
 #if NUM_DIGITS < 2
 #error The modular reduction implementation requires at least 2 digits
 #endif
+#if EXP_WINDOW < 1 || EXP_WINDOW > 6
+#error EXP_WINDOW must be 1 to 6
+#endif
+#if PRIVATE_KEY && REDUCE_METHOD != REDUCE_MONTGOMERY
+#error PRIVATE_KEY requires REDUCE_METHOD=REDUCE_MONTGOMERY
+#endif
+// mult_karatsuba() recurses, so it cannot be inlined into mod_exp()'s steps
+#if defined(RATCHET) && REDUCE_METHOD == REDUCE_DIVISION && \
+	KARATSUBA_THRESHOLD > 0 && NUM_DIGITS >= KARATSUBA_THRESHOLD
+#error Ratchet with REDUCE_DIVISION requires KARATSUBA_THRESHOLD=0
+#endif
+
+// The arithmetic under mod_mult() is inlined even at -O0: each step of
+// mod_exp() is an atomic region, from which no function of the app may be
+// called (src/atomic.h)
+#define BIGINT_INLINE static inline __attribute__((always_inline))
 
 #define PRINT_HEX_ASCII_COLS 8
 
+#if DIGIT_BITS == 8
 /** @brief Type large enough to store a product of two digits */
 typedef uint16_t digit_t;
+/** @brief Type large enough to store three digits (quotient refinement) */
+typedef uint32_t wide_t;
+#define DIGIT_FMT "%02x "
+// Product of two digits (int is 16-bit: a plain multiply)
+#define DIGIT_MULT(a, b) ((digit_t)((a) * (b)))
+#elif DIGIT_BITS == 16
+typedef uint32_t digit_t;
+typedef uint64_t wide_t;
+#define DIGIT_FMT "%04x "
+// Product of two digits, by the multiply helper. mult_digits() goes to the
+// MPY32 directly instead (mac.h); mont_mult() and reduce_multiply() add
+// each product into a digit they also read, one call at a time.
+#define DIGIT_MULT(a, b) mult16(a, b)
+#else
+#error DIGIT_BITS must be 8 or 16
+#endif
 
 /** @brief Multi-digit integer */
 typedef unsigned bigint_t[NUM_DIGITS * 2];
 
 typedef struct {
-	bigint_t n; // modulus
-	digit_t e;  // exponent
+	uint8_t n[KEY_SIZE_BYTES]; // modulus, as bytes
+	unsigned e;                // exponent
 } pubkey_t;
 
-// Blocks are padded with these digits (on the MSD side). Padding value must be
+// All LSB first; the primes have their top bit set
+typedef struct {
+	uint8_t d[KEY_SIZE_BYTES];        // private exponent
+	uint8_t p[KEY_SIZE_BYTES / 2];    // p * q == n
+	uint8_t q[KEY_SIZE_BYTES / 2];
+	uint8_t dp[KEY_SIZE_BYTES / 2];   // d mod (p - 1)
+	uint8_t dq[KEY_SIZE_BYTES / 2];   // d mod (q - 1)
+	uint8_t qinv[KEY_SIZE_BYTES / 2]; // q^-1 mod p
+} privkey_t;
+
+// Blocks are padded with these bytes (on the MSB side). Padding value must be
 // chosen such that block value is less than the modulus. This is accomplished
 // by any value below 0x80, because the modulus is restricted to be above
-// 0x80 (see comments below).
-static __ro_nv const uint8_t PAD_DIGITS[] = { 0x01 };
-#define NUM_PAD_DIGITS (sizeof(PAD_DIGITS) / sizeof(PAD_DIGITS[0]))
+// 0x80 (see comments below). Blocks are laid out in bytes, so that the
+// cyphertext does not depend on DIGIT_BITS.
+static __ro_nv const uint8_t PAD_BYTES[] = { 0x01 };
+#define NUM_PAD_BYTES (sizeof(PAD_BYTES) / sizeof(PAD_BYTES[0]))
+#define BLOCK_MSG_BYTES (KEY_SIZE_BYTES - NUM_PAD_BYTES)
 
-// To generate a key pair: see scripts/
+// To generate a key pair: see ext/python_dissembler/rsa_key.py
 
 // modulus: byte order: LSB to MSB, constraint MSB>=0x80
 static __ro_nv const pubkey_t pubkey = {
+#if KEY_SIZE_BITS == 64
+#include "../data/key64.txt"
+#elif KEY_SIZE_BITS == 256
 #include "../data/key256.txt"
-	//#include "../data/key64.txt"
+#elif KEY_SIZE_BITS == 1024
+#include "../data/key1024.txt"
+#elif KEY_SIZE_BITS == 2048
+#include "../data/key2048.txt"
+#else
+#error No key data for KEY_SIZE_BITS
+#endif
+};
+
+#if PRIVATE_KEY
+static __ro_nv const privkey_t privkey = {
+#if KEY_SIZE_BITS == 1024
+#include "../data/key1024_priv.txt"
+#elif KEY_SIZE_BITS == 2048
+#include "../data/key2048_priv.txt"
+#else
+#error No private key data for KEY_SIZE_BITS
+#endif
 };
+#endif // PRIVATE_KEY
 
 static __ro_nv const unsigned char PLAINTEXT[] =
 #include "../data/plaintext.txt"
 ;
 
-#define NUM_PLAINTEXT_BLOCKS (sizeof(PLAINTEXT) / (NUM_DIGITS - NUM_PAD_DIGITS) + 1)
-#define CYPHERTEXT_SIZE (NUM_PLAINTEXT_BLOCKS * NUM_DIGITS)
+#define NUM_PLAINTEXT_BLOCKS (sizeof(PLAINTEXT) / BLOCK_MSG_BYTES + 1)
+#define CYPHERTEXT_SIZE (NUM_PLAINTEXT_BLOCKS * KEY_SIZE_BYTES)
 
 __nv uint8_t CYPHERTEXT[CYPHERTEXT_SIZE] = {0};
 __nv unsigned CYPHERTEXT_LEN = 0;
 
+// A modulus in digits, with what mod_mult() needs to reduce by it
+typedef struct {
+	bigint_t n;
+	unsigned digits;           // length of n: NUM_DIGITS, or half for p and q
+#if REDUCE_METHOD == REDUCE_MONTGOMERY
+	unsigned one[NUM_DIGITS];  // R mod n: 1 in Montgomery form
+	unsigned r2[NUM_DIGITS];   // R^2 mod n
+	digit_t n_inv;             // -n^-1 mod radix
+#endif
+} modulus_t;
+
+// pubkey.n, set up at start-up
+__nv modulus_t modulus;
+
+#if PRIVATE_KEY
+// The private key in digits, set up at start-up
+typedef struct {
+	modulus_t p;
+	modulus_t q;
+	bigint_t qinv;
+} crt_t;
+
+__nv crt_t crt;
+#endif
+
+// Working numbers and blocks. They are kept in FRAM, not on the stack: at
+// 2048 bits a bigint_t is 512 B and a block 256 B, and the stack has well
+// under 2 KB. No function keeps a number of NUM_DIGITS or more, or a block,
+// on the stack.
+typedef struct {
+	uint8_t block[KEY_SIZE_BYTES]; // encrypt(), block_errors(): fill_block()
+#if PRIVATE_KEY && defined(BENCH)
+	uint8_t m[KEY_SIZE_BYTES];     // bench_private()
+#endif
+	bigint_t in_block;  // encrypt(), decrypt()
+	bigint_t out_block;
+	bigint_t product;   // mod_exp()
+	bigint_t qxn;       // reduce()
+	unsigned table[EXP_TABLE_SIZE][NUM_DIGITS]; // mod_exp(): odd powers
+	unsigned base_sq[NUM_DIGITS];
+#if REDUCE_METHOD == REDUCE_MONTGOMERY
+	unsigned mont[NUM_DIGITS + 2];     // mont_mult(): running sum t
+#endif
+#if PRIVATE_KEY
+	unsigned base[NUM_DIGITS];         // crt_exp(): c mod p or q
+	unsigned m1[NUM_DIGITS / 2];       // rsa_private_crt()
+	unsigned m2[NUM_DIGITS / 2];
+	unsigned h[NUM_DIGITS / 2];
+#endif
+#if KARATSUBA_THRESHOLD > 0 && NUM_DIGITS >= KARATSUBA_THRESHOLD
+	unsigned scratch[KARATSUBA_SCRATCH]; // mult_karatsuba()
+#endif
+} work_t;
+
+__nv work_t work;
+
+#ifdef BENCH
+// Modular multiplications and the cycles they took, since the last reset.
+// Counted through a volatile pointer from the atomic steps of mod_exp(), so
+// the ones redone after a failure count too.
+typedef struct {
+	uint32_t mults;
+	uint64_t cycles;
+} exp_stats_t;
+
+__nv exp_stats_t stats;
+#endif
+
 void print_bigint(const bigint_t n, unsigned digits)
 {
 	int i;
 	for (i = digits - 1; i >= 0; --i) {
-		PRINTF("%02x ", n[i]);
+		PRINTF(DIGIT_FMT, n[i]);
 	}
 }
 
@@ -100,7 +283,7 @@ void log_bigint(const bigint_t n, unsigned digits)
 	BLOCK_PRINTF_BEGIN();
 	int i;
 	for (i = digits - 1; i >= 0; --i) {
-		BLOCK_PRINTF("%02x ", n[i]);
+		BLOCK_PRINTF(DIGIT_FMT, n[i]);
 	}
 	BLOCK_PRINTF("\r\n");
 	BLOCK_PRINTF_END();
@@ -128,41 +311,176 @@ void print_hex_ascii(const uint8_t *m, unsigned len)
 	BLOCK_PRINTF_END();
 }
 
-void mult(bigint_t a, bigint_t b, bigint_t product)
+// Digits from bytes, LSB first; the digits above len bytes are cleared
+void bigint_from_bytes(bigint_t a, const uint8_t *bytes, unsigned len)
 {
-	int i;
-	unsigned digit;
-	digit_t p, c, dp;
+	unsigned i;
+
+	for (i = 0; i < NUM_DIGITS * 2; ++i)
+		a[i] = 0;
+	for (i = 0; i < len; ++i)
+		a[i / DIGIT_BYTES] |= (unsigned)bytes[i] << (8 * (i % DIGIT_BYTES));
+}
+
+// Schoolbook product of two n-digit numbers into 2n digits
+#if DIGIT_BITS == 8
+BIGINT_INLINE void mult_digits(const unsigned *a, const unsigned *b,
+		unsigned *product, unsigned n)
+{
+	unsigned digit, first, last;
+	uint32_t sum;
 	digit_t carry = 0;
 
 	//    PRINTF("mult: a = "); log_bigint(a, NUM_DIGITS); BLOCK_LOG("\r\n");
 	//    PRINTF("mult: b = "); log_bigint(b, NUM_DIGITS); BLOCK_LOG("\r\n");
 
-	for (digit = 0; digit < NUM_DIGITS * 2; ++digit) {
+	for (digit = 0; digit < n * 2; ++digit) {
 		LOG("mult: d=%u\r\n", digit);
 
-		p = carry;
-		c = 0;
-		for (i = 0; i < NUM_DIGITS; ++i) {
-			if (i <= digit && digit - i < NUM_DIGITS) {
-				dp = a[digit - i] * b[i];
+		// Column sum of a[digit - i] * b[i] over the digits of both: at
+		// most n products of two digits, well within 32 bits
+		first = (digit < n) ? 0 : digit - (n - 1);
+		last = (digit < n) ? digit : n - 1;
+		sum = carry + mac_dot_rev(&b[first], &a[digit - first],
+				last + 1 - first);
 
-				c += dp >> DIGIT_BITS;
-				p += dp & DIGIT_MASK;
+		LOG("mult: i=%u..%u sum=%04x%04x\r\n", first, last,
+				(uint16_t)(sum >> 16), (uint16_t)sum);
 
-				LOG("mult: i=%u a=%x b=%x dp=%x p=%x\r\n", i, a[digit - i], b[i], dp, p);
-			}
-		}
+		product[digit] = sum & DIGIT_MASK;
+		carry = sum >> DIGIT_BITS;
+	}
+}
+#else // DIGIT_BITS == 16
+// The same column by column, but a column of 16-bit digit products can
+// exceed 32 bits: mac_dot_rev_wide() sums it to 48, counting the carries
+// out of the accumulator. Each digit of the product is written once, from
+// a and b only.
+BIGINT_INLINE void mult_digits(const unsigned *a, const unsigned *b,
+		unsigned *product, unsigned n)
+{
+	unsigned digit, first, last;
+	uint32_t carry = 0;
 
-		c += p >> DIGIT_BITS;
-		p &= DIGIT_MASK;
+	for (digit = 0; digit < n * 2; ++digit) {
+		first = (digit < n) ? 0 : digit - (n - 1);
+		last = (digit < n) ? digit : n - 1;
+		product[digit] = mac_dot_rev_wide(&b[first], &a[digit - first],
+				last + 1 - first, &carry);
+
+		LOG("mult: d=%u i=%u..%u carry=%lx\r\n", digit, first, last,
+				(unsigned long)carry);
+	}
+}
+#endif // DIGIT_BITS
+
+// r = a + b over n digits, returns the carry; r may be a or b
+BIGINT_INLINE unsigned add_digits(unsigned *r, const unsigned *a,
+		const unsigned *b, unsigned n)
+{
+	unsigned i, c = 0;
+	digit_t s;
 
-		product[digit] = p;
-		carry = c;
+	for (i = 0; i < n; ++i) {
+		s = (digit_t)a[i] + b[i] + c;
+		r[i] = s & DIGIT_MASK;
+		c = s >> DIGIT_BITS;
 	}
+	return c;
 }
 
-bool reduce_normalizable(bigint_t m, const bigint_t n, unsigned d)
+// r = a - b over n digits, returns the borrow; r may be a or b
+BIGINT_INLINE unsigned sub_digits(unsigned *r, const unsigned *a,
+		const unsigned *b, unsigned n)
+{
+	unsigned i, c = 0;
+	digit_t s;
+
+	for (i = 0; i < n; ++i) {
+		s = (digit_t)a[i] - b[i] - c;
+		r[i] = s & DIGIT_MASK;
+		c = (s >> DIGIT_BITS) & 1;
+	}
+	return c;
+}
+
+// Compare a and b over n digits: -1, 0 or 1
+BIGINT_INLINE int cmp_digits(const unsigned *a, const unsigned *b, unsigned n)
+{
+	while (n--) {
+		if (a[n] != b[n])
+			return a[n] > b[n] ? 1 : -1;
+	}
+	return 0;
+}
+
+BIGINT_INLINE void copy_digits(unsigned *r, const unsigned *a, unsigned n)
+{
+	unsigned i;
+
+	for (i = 0; i < n; ++i)
+		r[i] = a[i];
+}
+
+#if KARATSUBA_THRESHOLD > 0 && NUM_DIGITS >= KARATSUBA_THRESHOLD
+// Karatsuba: with a = a1 R^h + a0 and b = b1 R^h + b0, h = n / 2,
+//   a * b = z2 R^2h + (z1 - z2 - z0) R^h + z0
+// where z0 = a0 b0, z2 = a1 b1 and z1 = (a0 + a1)(b0 + b1): three half-size
+// products instead of four. Halves below KARATSUBA_THRESHOLD digits (or of
+// odd length) go to the schoolbook loops. scratch takes 2n + 2 digits per
+// level, under KARATSUBA_SCRATCH in all.
+void mult_karatsuba(const unsigned *a, const unsigned *b, unsigned *product,
+		unsigned n, unsigned *scratch)
+{
+	unsigned h = n / 2;
+	unsigned *sa = scratch;          // a0 + a1, h digits and carry ca
+	unsigned *sb = scratch + h;      // b0 + b1, h digits and carry cb
+	unsigned *z1 = scratch + 2 * h;  // 2h + 1 digits
+	unsigned *rest = scratch + 4 * h + 2;
+	unsigned ca, cb, i, c;
+	digit_t s;
+
+	if (n < KARATSUBA_THRESHOLD || (n & 1)) {
+		mult_digits(a, b, product, n);
+		return;
+	}
+
+	mult_karatsuba(a, b, product, h, rest);                 // z0
+	mult_karatsuba(a + h, b + h, product + 2 * h, h, rest); // z2
+
+	// (sa + ca R^h)(sb + cb R^h) = sa sb + (ca sb + cb sa) R^h + ca cb R^2h
+	ca = add_digits(sa, a, a + h, h);
+	cb = add_digits(sb, b, b + h, h);
+	mult_karatsuba(sa, sb, z1, h, rest);
+	z1[2 * h] = ca & cb;
+	if (ca)
+		z1[2 * h] += add_digits(z1 + h, z1 + h, sb, h);
+	if (cb)
+		z1[2 * h] += add_digits(z1 + h, z1 + h, sa, h);
+
+	z1[2 * h] -= sub_digits(z1, z1, product, 2 * h);
+	z1[2 * h] -= sub_digits(z1, z1, product + 2 * h, 2 * h);
+
+	// product += z1 R^h; the sum fits in 2n digits, so the carry stops
+	c = add_digits(product + h, product + h, z1, 2 * h + 1);
+	for (i = 3 * h + 1; c && i < 2 * n; ++i) {
+		s = (digit_t)product[i] + c;
+		product[i] = s & DIGIT_MASK;
+		c = s >> DIGIT_BITS;
+	}
+}
+#endif // KARATSUBA_THRESHOLD
+
+BIGINT_INLINE void mult(const unsigned *a, const unsigned *b, unsigned *product)
+{
+#if KARATSUBA_THRESHOLD > 0 && NUM_DIGITS >= KARATSUBA_THRESHOLD
+	mult_karatsuba(a, b, product, NUM_DIGITS, work.scratch);
+#else
+	mult_digits(a, b, product, NUM_DIGITS);
+#endif
+}
+
+BIGINT_INLINE bool reduce_normalizable(bigint_t m, const bigint_t n, unsigned d)
 {
 	int i;
 	unsigned offset;
@@ -188,7 +506,8 @@ bool reduce_normalizable(bigint_t m, const bigint_t n, unsigned d)
 	return normalizable;
 }
 
-void reduce_normalize(bigint_t m, const bigint_t n, unsigned digit)
+BIGINT_INLINE void reduce_normalize(bigint_t m, const bigint_t n,
+		unsigned digit)
 {
 	int i;
 	digit_t d, s, m_d, n_d;
@@ -203,7 +522,7 @@ void reduce_normalize(bigint_t m, const bigint_t n, unsigned digit)
 
 		s = n_d + borrow;
 		if (m_d < s) {
-			m_d += 1 << DIGIT_BITS;
+			m_d += (digit_t)1 << DIGIT_BITS;
 			borrow = 1;
 		} else {
 			borrow = 0;
@@ -217,23 +536,24 @@ void reduce_normalize(bigint_t m, const bigint_t n, unsigned digit)
 	}
 }
 
-void reduce_quotient(digit_t *quotient, bigint_t m, const bigint_t n, unsigned d)
+BIGINT_INLINE void reduce_quotient(digit_t *quotient, bigint_t m,
+		const bigint_t n, unsigned d)
 {
 	digit_t q, n_div;
-	uint32_t n_q, qn;
+	wide_t n_q, qn;
 	uint16_t m_dividend;
 
 	// Divisor, derived from modulus, for refining quotient guess into exact value
-	n_div = ((n[NUM_DIGITS - 1] << DIGIT_BITS) + n[NUM_DIGITS - 2]);
+	n_div = ((digit_t)n[NUM_DIGITS - 1] << DIGIT_BITS) + n[NUM_DIGITS - 2];
 
 	LOG("reduce: quotient: r_n=%x m[d]=%x\r\n", n[NUM_DIGITS-1], m[d]);
 
 	// Choose an initial guess for quotient
 	if (m[d] == n[NUM_DIGITS - 1]) {
-		q = (1 << DIGIT_BITS) - 1;
+		q = DIGIT_MASK;
 	} else {
 		// TODO: The long todo described below applies here.
-		q = ((m[d] << DIGIT_BITS) + m[d-1]) / n[NUM_DIGITS - 1];
+		q = (((digit_t)m[d] << DIGIT_BITS) + m[d-1]) / n[NUM_DIGITS - 1];
 		LOG("reduce quotient: m_dividend=%x q=%x\r\n", m_dividend, q);
 	}
 
@@ -242,7 +562,8 @@ void reduce_quotient(digit_t *quotient, bigint_t m, const bigint_t n, unsigned d
 	// TODO: An alternative to composing the digits into one variable, is to
 	// have a loop that does the comparison digit by digit to implement the
 	// condition of the while loop below.
-	n_q = ((uint32_t)m[d] << (2 * DIGIT_BITS)) + (m[d-1] << DIGIT_BITS) + m[d-2];
+	n_q = ((wide_t)m[d] << (2 * DIGIT_BITS)) + ((digit_t)m[d-1] << DIGIT_BITS) +
+		m[d-2];
 
 	LOG("reduce: quotient: m[d]=%x m[d-1]=%x m[d-2]=%x n_q=%02x%02x\r\n",
 			m[d], m[d-1], m[d-2],
@@ -268,7 +589,11 @@ void reduce_quotient(digit_t *quotient, bigint_t m, const bigint_t n, unsigned d
 		// using libgcc's ones for inspiration (watching the calling convention
 		// carefully).
 		//
+#if DIGIT_BITS == 8
 		qn = mult16(n_div, q);
+#else // 32x16 bits in two halves: q < radix, as m[d] <= n[NUM_DIGITS - 1]
+		qn = ((wide_t)mult16(n_div >> 16, q) << 16) + mult16(n_div, q);
+#endif
 		LOG("reduce: quotient: q=%x n_div=%x qn=%02x%02x\r\n", q, n_div,
 				(uint16_t)((qn >> 16) & 0xffff), (uint16_t)(qn & 0xffff));
 	} while (qn > n_q);
@@ -280,7 +605,8 @@ void reduce_quotient(digit_t *quotient, bigint_t m, const bigint_t n, unsigned d
 	*quotient = q;
 }
 
-void reduce_multiply(bigint_t product, digit_t q, const bigint_t n, unsigned d)
+BIGINT_INLINE void reduce_multiply(bigint_t product, digit_t q,
+		const bigint_t n, unsigned d)
 {
 	int i;
 	unsigned offset, c;
@@ -306,7 +632,7 @@ void reduce_multiply(bigint_t product, digit_t q, const bigint_t n, unsigned d)
 		p = c;
 		if (i < offset + NUM_DIGITS) {
 			nd = n[i - offset];
-			p += q * nd;
+			p += DIGIT_MULT(q, nd);
 		} else {
 			nd = 0;
 			// TODO: could break out of the loop  in this case (after CHAN_OUT)
@@ -322,7 +648,7 @@ void reduce_multiply(bigint_t product, digit_t q, const bigint_t n, unsigned d)
 	}
 }
 
-int reduce_compare(bigint_t a, bigint_t b)
+BIGINT_INLINE int reduce_compare(bigint_t a, bigint_t b)
 {
 	LOG("reduce: compare\r\n");
 	int i;
@@ -342,7 +668,7 @@ int reduce_compare(bigint_t a, bigint_t b)
 	return relation;
 }
 
-void reduce_add(bigint_t a, const bigint_t b, unsigned d)
+BIGINT_INLINE void reduce_add(bigint_t a, const bigint_t b, unsigned d)
 {
 	int i, j;
 	unsigned offset, c;
@@ -378,7 +704,7 @@ void reduce_add(bigint_t a, const bigint_t b, unsigned d)
 	}
 }
 
-void reduce_subtract(bigint_t a, bigint_t b, unsigned d)
+BIGINT_INLINE void reduce_subtract(bigint_t a, bigint_t b, unsigned d)
 {
 	int i;
 	digit_t m, s, r, qn;
@@ -398,7 +724,7 @@ void reduce_subtract(bigint_t a, bigint_t b, unsigned d)
 
 		s = qn + borrow;
 		if (m < s) {
-			m += 1 << DIGIT_BITS;
+			m += (digit_t)1 << DIGIT_BITS;
 			borrow = 1;
 		} else {
 			borrow = 0;
@@ -412,11 +738,11 @@ void reduce_subtract(bigint_t a, bigint_t b, unsigned d)
 	}
 }
 
-void reduce(bigint_t m, const bigint_t n)
+BIGINT_INLINE void reduce(bigint_t m, const bigint_t n)
 {
 	digit_t q;
 	unsigned d;
-	bigint_t qxn;
+	unsigned *qxn = work.qxn;
 
 	// Start reduction loop at most significant non-zero digit
 	d = 2 * NUM_DIGITS;
@@ -444,84 +770,631 @@ void reduce(bigint_t m, const bigint_t n)
 	}
 }
 
-void mod_mult(bigint_t a, bigint_t b, const bigint_t n, bigint_t product)
+// Montgomery multiplication, CIOS (coarsely integrated operand scanning):
+// mont_mult() returns a * b / R mod n, with R = radix^digits, by
+// interleaving one row of a * b with one digit of reduction: the multiple
+// of n added in each row clears the lowest digit, which is then shifted
+// out. There is no trial division and the running sum t never exceeds
+// digits + 2 digits. Operands are kept in Montgomery form, x * R mod n:
+// mod_exp() converts in with a multiplication by R^2 mod n and back out
+// with a multiplication by 1. Requires n odd, as any RSA modulus or prime
+// factor is, with its top bit set.
+#if REDUCE_METHOD == REDUCE_MONTGOMERY
+// a * b must be below R * n: true for a, b < n, and for any a < R if b < n.
+// product may be a or b.
+BIGINT_INLINE void mont_mult(const unsigned *a, const unsigned *b,
+		const modulus_t *mod, unsigned *product)
+{
+	const unsigned *n = mod->n;
+	unsigned nd = mod->digits;
+	unsigned *t = work.mont;
+	digit_t p, m;
+	unsigned c;
+	int i, j;
+
+	for (j = 0; j < nd + 2; ++j)
+		t[j] = 0;
+
+	for (i = 0; i < nd; ++i) {
+		// t += a * b[i]
+		c = 0;
+		for (j = 0; j < nd; ++j) {
+			p = t[j] + DIGIT_MULT(a[j], b[i]) + c;
+			t[j] = p & DIGIT_MASK;
+			c = p >> DIGIT_BITS;
+		}
+		p = t[nd] + c;
+		t[nd] = p & DIGIT_MASK;
+		t[nd + 1] = p >> DIGIT_BITS;
+
+		// t = (t + m * n) / radix, where m makes the lowest digit zero
+		m = DIGIT_MULT(t[0], mod->n_inv) & DIGIT_MASK;
+		p = t[0] + DIGIT_MULT(m, n[0]);
+		c = p >> DIGIT_BITS;
+		for (j = 1; j < nd; ++j) {
+			p = t[j] + DIGIT_MULT(m, n[j]) + c;
+			t[j - 1] = p & DIGIT_MASK;
+			c = p >> DIGIT_BITS;
+		}
+		p = t[nd] + c;
+		t[nd - 1] = p & DIGIT_MASK;
+		t[nd] = t[nd + 1] + (p >> DIGIT_BITS);
+	}
+
+	// t < 2n: at most one subtraction of n
+	if (t[nd] != 0 || cmp_digits(t, n, nd) >= 0)
+		sub_digits(t, t, n, nd);
+
+	copy_digits(product, t, nd);
+}
+
+// From mod->n and mod->digits, the rest of mod
+void mont_init(modulus_t *mod)
+{
+	const unsigned *n = mod->n;
+	unsigned nd = mod->digits;
+	unsigned *x = work.product;
+	unsigned i, k, squarings;
+	digit_t inv;
+
+	// Newton iteration for n[0]^-1: n[0] * n[0] == 1 mod 8 for odd n, and
+	// every step doubles the number of correct low bits
+	inv = n[0];
+	for (i = 0; i < 3; ++i)
+		inv = inv * (2 - n[0] * inv);
+	mod->n_inv = -inv & DIGIT_MASK;
+
+	// R mod n = R - n, as R / 2 <= n < R
+	for (i = 0; i < nd; ++i)
+		x[i] = 0;
+	sub_digits(mod->one, x, n, nd);
+
+	// R^2 mod n = R 2^(log2 R) mod n. Double R mod n up to R 2^k, then
+	// square it in Montgomery form (R 2^k -> R 2^2k) as many times as
+	// log2 R = k 2^squarings allows: a few hundred subtractions and a
+	// handful of mont_mult()s instead of a division.
+	k = nd * DIGIT_BITS;
+	squarings = 0;
+	while (!(k & 1) && k > DIGIT_BITS) {
+		k >>= 1;
+		squarings++;
+	}
+	copy_digits(x, mod->one, nd);
+	for (i = 0; i < k; ++i) {
+		if (add_digits(x, x, x, nd) || cmp_digits(x, n, nd) >= 0)
+			sub_digits(x, x, n, nd);
+	}
+	for (i = 0; i < squarings; ++i)
+		mont_mult(x, x, mod, x);
+	copy_digits(mod->r2, x, nd);
+
+	LOG("mont: n_inv=%x\r\n", mod->n_inv);
+}
+#endif // REDUCE_MONTGOMERY
+
+// Counted, with its cycles, in stats (BENCH)
+BIGINT_INLINE void mod_mult(const unsigned *a, const unsigned *b,
+		const modulus_t *mod, unsigned *product)
 {
+	bench_t start = bench_start();
+
+#if REDUCE_METHOD == REDUCE_MONTGOMERY
+	mont_mult(a, b, mod, product);
+#else
 	mult(a, b, product);
-	reduce(product, n);
+	reduce(product, mod->n);
+#endif
+#ifdef BENCH
+	volatile exp_stats_t *st = &stats;
+
+	st->cycles += bench_elapsed(start);
+	st->mults++;
+#endif
+}
+
+// r = a * b mod n; r may be a or b. With Montgomery reduction the product
+// is built in work.mont, and r is written only once it is done.
+BIGINT_INLINE void mod_mult_to(unsigned *r, const unsigned *a,
+		const unsigned *b, const modulus_t *mod)
+{
+#if REDUCE_METHOD == REDUCE_MONTGOMERY
+	mod_mult(a, b, mod, r);
+#else
+	mod_mult(a, b, mod, work.product);
+	copy_digits(r, work.product, mod->digits);
+#endif
 }
 
-void mod_exp(bigint_t out_block, bigint_t base, digit_t e, const bigint_t n)
+#define EXP_BIT(e, i) (((e)[(i) >> 3] >> ((i) & 7)) & 1)
+
+// Window width for an exponent of this many bits, at most max: the table
+// costs 2^(w-1) multiplications up front, each window saves about w - 1.
+// A small public exponent is best done bit by bit.
+unsigned exp_window(unsigned bits, unsigned max)
 {
-	bigint_t product;
+	unsigned w;
+
+	if (bits > 671)
+		w = 6;
+	else if (bits > 239)
+		w = 5;
+	else if (bits > 79)
+		w = 4;
+	else if (bits > 23)
+		w = 3;
+	else
+		w = 1;
+	return w < max ? w : max;
+}
+
+// Resumable exponentiation.
+//
+// mod_exp() scans e left to right: a zero bit is a squaring, and a run of
+// up to window bits that starts and ends with a one is a squaring per bit
+// and one multiplication by an odd power of the base, from work.table.
+// Each step is one modular multiplication (or, for the first window, a
+// copy from the table), run as an atomic region: it reads committed state
+// only and writes the other of two copies of the accumulator in FRAM, then
+// cur flips to it (one word). As a step writes nothing it reads, a step
+// cut short by a failure runs again whole, without an undo log; work.mont
+// and work.product are scratch, written before they are read. The table
+// is built the same way, one multiplication a step, each entry from
+// committed ones. Without Ratchet, a fresh start that calls mod_exp()
+// again with the same arguments resumes at the first uncommitted step.
+typedef struct {
+	unsigned acc[NUM_DIGITS]; // accumulator (Montgomery form)
+	int bit;                  // next bit of e to scan, -1 when done
+	int low;                  // last bit of the open window
+	unsigned value;           // bits of the open window, 0 when none is
+	bool started;             // acc holds a power of the base, not 1
+} exp_copy_t;
+
+typedef struct {
+	exp_copy_t copy[2];
+	unsigned cur;        // the committed copy
+	unsigned table_step; // table steps committed, see exp_table_step()
+	unsigned window;
+	bool running;        // an exponentiation is under way
+	uint32_t steps;      // steps committed, since exp_progress_reset()
+	uint32_t begun;      // steps begun, including ones redone after a failure
+} exp_state_t;
+
+__nv exp_state_t exp_state;
+
+// Steps to build the table for a window: table[0], then base_sq and the
+// other entries
+#define EXP_TABLE_STEPS(w) ((w) > 1 ? (1u << ((w) - 1)) + 1 : 1)
+
+void exp_progress_reset()
+{
+	exp_state.steps = 0;
+	*(volatile uint32_t *)&exp_state.begun = 0;
+}
+
+void exp_start(const uint8_t *e, unsigned e_bytes, const modulus_t *mod,
+		unsigned window)
+{
+	exp_copy_t *c = &exp_state.copy[exp_state.cur];
 	int i;
 
-	// Result initialized to 1
-	out_block[0] = 0x1;
-	for (i = 1; i < NUM_DIGITS; ++i)
-		out_block[i] = 0x0;
-
-	while (e > 0) { //arbitrary bound
-		LOG("mod exp: e=%x\r\n", e);
-
-		// Looks weird, but tried my best to mimic
-		// the Alpaca code
-		if (e & 0x1) {
-			e >>= 1;
-			mod_mult(out_block, base, n, product);
-			for (unsigned i = 0; i < NUM_DIGITS; ++i)
-				out_block[i] = product[i];
-			if (e <= 0) {
-				break;
-			}
-			else {
-				mod_mult(base, base, n, product);
-				for (unsigned i = 0; i < NUM_DIGITS; ++i)
-					base[i] = product[i];
-			}
-		}
-		else {
-			e >>= 1;
-			mod_mult(base, base, n, product);
-			for (unsigned i = 0; i < NUM_DIGITS; ++i)
-				base[i] = product[i];
+	i = e_bytes * 8 - 1;
+	while (i >= 0 && !EXP_BIT(e, i))
+		--i;
+	c->bit = i;
+	c->value = 0;
+	c->started = false;
+#if REDUCE_METHOD == REDUCE_MONTGOMERY
+	copy_digits(c->acc, mod->one, mod->digits);
+#else
+	c->acc[0] = 0x1;
+	for (i = 1; i < mod->digits; ++i)
+		c->acc[i] = 0x0;
+#endif
+	exp_state.window = exp_window(c->bit + 1, window);
+	exp_state.table_step = 0;
+	exp_state.running = true; // commit
+	LOG("mod exp: bits=%d window=%u\r\n", c->bit + 1, exp_state.window);
+}
+
+// Step 0 is table[0] = base, in Montgomery form; step 1 base_sq = base^2;
+// step k > 1 table[k - 1] = table[k - 2] * base_sq = base^(2k - 1). No
+// step writes an entry it reads.
+void exp_table_step(const unsigned *base, const modulus_t *mod)
+{
+	unsigned k = exp_state.table_step;
+	uint32_t steps = exp_state.steps;
+	const unsigned *a, *b;
+	unsigned *r;
+
+	RATCHET_ATOMIC_BEGIN();
+	(*(volatile uint32_t *)&exp_state.begun)++; // not rolled back
+
+	if (k == 0) {
+		r = work.table[0];
+		a = base;
+#if REDUCE_METHOD == REDUCE_MONTGOMERY
+		b = mod->r2;
+#else
+		b = NULL;
+#endif
+	} else if (k == 1) {
+		r = work.base_sq;
+		a = work.table[0];
+		b = work.table[0];
+	} else {
+		r = work.table[k - 1];
+		a = work.table[k - 2];
+		b = work.base_sq;
+	}
+	if (b)
+		mod_mult_to(r, a, b, mod);
+	else
+		copy_digits(r, a, mod->digits);
+
+	exp_state.table_step = k + 1; // commit
+	exp_state.steps = steps + 1;
+	RATCHET_ATOMIC_END();
+}
+
+void exp_step(const uint8_t *e, const modulus_t *mod)
+{
+	unsigned cur = exp_state.cur;
+	uint32_t steps = exp_state.steps;
+	const exp_copy_t *from = &exp_state.copy[cur];
+	exp_copy_t *to = &exp_state.copy[cur ^ 1];
+	unsigned nd = mod->digits;
+	const unsigned *b;
+	unsigned value;
+	int i, j, low;
+
+	RATCHET_ATOMIC_BEGIN();
+	(*(volatile uint32_t *)&exp_state.begun)++; // not rolled back
+
+	i = from->bit;
+	low = from->low;
+	value = from->value;
+	if (value == 0 && EXP_BIT(e, i)) {
+		// Open the longest window from bit i down that ends with a one
+		low = i - (int)exp_state.window + 1;
+		if (low < 0)
+			low = 0;
+		while (!EXP_BIT(e, low))
+			++low;
+		for (j = i; j >= low; --j)
+			value = (value << 1) | EXP_BIT(e, j);
+	}
+
+	if (!from->started) {
+		// Squaring 1 is skipped, and so is the first multiplication
+		copy_digits(to->acc, work.table[value >> 1], nd);
+		i = low - 1;
+		value = 0;
+	} else {
+		if (value != 0 && i < low) {
+			// The window is squared in: multiply it in and close it
+			b = work.table[value >> 1];
+			value = 0;
+		} else {
+			b = from->acc;
+			--i;
 		}
+		mod_mult_to(to->acc, from->acc, b, mod);
+	}
+
+	to->bit = i;
+	to->low = low;
+	to->value = value;
+	to->started = true;
+	exp_state.cur = cur ^ 1; // commit
+	exp_state.steps = steps + 1;
+	RATCHET_ATOMIC_END();
+}
+
+// out_block = base^e mod n, for e of e_bytes bytes, LSB first, in windows
+// of up to window bits (1 for plain square-and-multiply)
+void mod_exp(unsigned *out_block, const unsigned *base, const uint8_t *e,
+		unsigned e_bytes, const modulus_t *mod, unsigned window)
+{
+	const exp_copy_t *c;
+
+	if (!exp_state.running)
+		exp_start(e, e_bytes, mod, window);
+
+	while (exp_state.table_step < EXP_TABLE_STEPS(exp_state.window))
+		exp_table_step(base, mod);
+	while (exp_state.copy[exp_state.cur].bit >= 0 ||
+			exp_state.copy[exp_state.cur].value != 0)
+		exp_step(e, mod);
+
+	c = &exp_state.copy[exp_state.cur];
+#if REDUCE_METHOD == REDUCE_MONTGOMERY
+	// Out of Montgomery form: multiply by 1, kept in the idle copy
+	unsigned *one = exp_state.copy[exp_state.cur ^ 1].acc;
+	unsigned i;
+	one[0] = 0x1;
+	for (i = 1; i < mod->digits; ++i)
+		one[i] = 0x0;
+	mod_mult_to(out_block, c->acc, one, mod);
+#else
+	copy_digits(out_block, c->acc, mod->digits);
+#endif
+	exp_state.running = false; // commit
+}
+
+// Block cursors for encrypt() and decrypt(), so that a fresh start resumes
+// at the block (and CRT stage) it was in
+typedef struct {
+	unsigned enc_block; // blocks committed to the cyphertext
+	unsigned dec_block; // blocks committed to DECRYPTED
+	unsigned stage;     // rsa_private_crt() stages done in dec_block
+} rsa_progress_t;
+
+__nv rsa_progress_t progress;
+
+#if PRIVATE_KEY
+__nv uint8_t DECRYPTED[CYPHERTEXT_SIZE];
+
+// From privkey, checked against the public modulus
+void crt_init()
+{
+	unsigned half = NUM_DIGITS / 2;
+
+	bigint_from_bytes(crt.p.n, privkey.p, KEY_SIZE_BYTES / 2);
+	crt.p.digits = half;
+	mont_init(&crt.p);
+	bigint_from_bytes(crt.q.n, privkey.q, KEY_SIZE_BYTES / 2);
+	crt.q.digits = half;
+	mont_init(&crt.q);
+	bigint_from_bytes(crt.qinv, privkey.qinv, KEY_SIZE_BYTES / 2);
+
+	mult_digits(crt.p.n, crt.q.n, work.product, half);
+	if (cmp_digits(work.product, modulus.n, NUM_DIGITS) != 0)
+		PRINTF("rsa: private key does not match the public key\r\n");
+}
+
+// x = c mod p, for c of twice p's digits: with c = c1 R + c0, mont_mult()
+// of c1 and R^2 gives c1 R mod p, and c0 < R < 2p
+void crt_reduce(unsigned *x, const unsigned *c, const modulus_t *mod)
+{
+	unsigned nd = mod->digits;
+	unsigned carry;
+
+	mod_mult_to(x, c + nd, mod->r2, mod);
+	carry = add_digits(x, x, c, nd);
+	while (carry || cmp_digits(x, mod->n, nd) >= 0)
+		carry -= sub_digits(x, x, mod->n, nd);
+}
+
+// m = c^d mod n, directly: the baseline for rsa_private_crt()
+void rsa_private(unsigned *m, const unsigned *c, unsigned window)
+{
+	mod_exp(m, c, privkey.d, KEY_SIZE_BYTES, &modulus, window);
+}
+
+// m = c^d' mod p, for one of the primes and its d' = d mod (p - 1)
+void crt_exp(unsigned *m, const unsigned *c, const uint8_t *d,
+		const modulus_t *mod, unsigned window)
+{
+	crt_reduce(work.base, c, mod);
+	mod_exp(m, work.base, d, KEY_SIZE_BYTES / 2, mod, window);
+}
+
+// m = m2 + h q < n, with h = qInv (m1 - m2) mod p
+void crt_combine(unsigned *m)
+{
+	unsigned half = NUM_DIGITS / 2;
+	unsigned i, carry;
+	digit_t s;
+
+	// m1 - (m2 mod p), mod p: m2 < q < 2p
+	copy_digits(work.h, work.m2, half);
+	if (cmp_digits(work.h, crt.p.n, half) >= 0)
+		sub_digits(work.h, work.h, crt.p.n, half);
+	if (sub_digits(work.h, work.m1, work.h, half))
+		add_digits(work.h, work.h, crt.p.n, half);
+
+	// Times qInv: out of Montgomery form with one more mont_mult() by R^2
+	mod_mult_to(work.h, work.h, crt.qinv, &crt.p);
+	mod_mult_to(work.h, work.h, crt.p.r2, &crt.p);
+
+	mult_digits(work.h, crt.q.n, m, half);
+	carry = add_digits(m, m, work.m2, half);
+	for (i = half; carry && i < NUM_DIGITS; ++i) {
+		s = (digit_t)m[i] + carry;
+		m[i] = s & DIGIT_MASK;
+		carry = s >> DIGIT_BITS;
 	}
 }
 
+// m = c^d mod n by the CRT: m1 = c^dP mod p, m2 = c^dQ mod q, then
+// h = qInv (m1 - m2) mod p and m = m2 + h q. Two exponentiations with
+// half-length exponents over half-length moduli: about a quarter of the
+// work of rsa_private(). Decryption and signing are both this.
+void rsa_private_crt(unsigned *m, const unsigned *c, unsigned window)
+{
+	crt_exp(work.m1, c, privkey.dp, &crt.p, window);
+	crt_exp(work.m2, c, privkey.dq, &crt.q, window);
+	crt_combine(m);
+}
+#endif // PRIVATE_KEY
+
+void bench_reset()
+{
+#ifdef BENCH
+	stats.mults = 0;
+	stats.cycles = 0;
+#endif
+}
+
+void print_bench(const char *op, unsigned window, unsigned blocks)
+{
+#ifdef BENCH
+	PRINTF("bench: %s, window %u: %lu mod mults, %lu kcycles per block\r\n",
+			op, window, (unsigned long)(stats.mults / blocks),
+			(unsigned long)(stats.cycles / blocks / 1000));
+#endif
+}
+
+void print_footprint()
+{
+#ifdef BENCH
+	unsigned key = sizeof(pubkey);
+	unsigned key_state = sizeof(modulus);
+#if PRIVATE_KEY
+	key += sizeof(privkey);
+	key_state += sizeof(crt);
+#endif
+
+	PRINTF("bench: %u-bit key, %u-bit digits, %s, karatsuba %u, window %u\r\n",
+			KEY_SIZE_BITS, DIGIT_BITS,
+			REDUCE_METHOD == REDUCE_MONTGOMERY ? "montgomery" : "division",
+			KARATSUBA_THRESHOLD, EXP_WINDOW);
+	PRINTF("bench: FRAM: key %u B, key state %u B, working %u B, "
+			"exp state %u B\r\n", key, key_state, (unsigned)sizeof(work),
+			(unsigned)sizeof(exp_state));
+#endif
+}
+
+// The offset-th block of the message: BLOCK_MSG_BYTES of it, filled out
+// with 0xFF, then the padding
+void fill_block(uint8_t *block, const uint8_t *message,
+		unsigned message_length, unsigned offset)
+{
+	int i;
+
+	for (i = 0; i < BLOCK_MSG_BYTES; ++i)
+		block[i] = (offset + i < message_length) ?
+			message[offset + i] : 0xFF;
+	for (i = 0; i < NUM_PAD_BYTES; ++i)
+		block[BLOCK_MSG_BYTES + i] = PAD_BYTES[i];
+}
+
+// Resumes at progress.enc_block
 void encrypt(uint8_t *cyphertext, unsigned *cyphertext_len,
 		const uint8_t *message, unsigned message_length,
-		const pubkey_t *k)
+		const modulus_t *mod, unsigned e)
 {
 	int i;
 	unsigned in_block_offset, out_block_offset;
-	bigint_t in_block;
-	bigint_t out_block;
+	uint8_t *block = work.block;
+	uint8_t e_bytes[2] = { e & 0xff, e >> 8 };
+	unsigned *in_block = work.in_block;
+	unsigned *out_block = work.out_block;
+
+	bench_reset();
 
-	in_block_offset = 0;
-	out_block_offset = 0;
 	LOG("cyphertext len: %u\r\n", message_length);
-	while (in_block_offset < message_length) { //arb bound
+	while ((in_block_offset = progress.enc_block * BLOCK_MSG_BYTES) <
+			message_length) { //arb bound
+		out_block_offset = progress.enc_block * KEY_SIZE_BYTES;
 		LOG("Blk offset: %u\r\n", in_block_offset);
 
-		for (i = 0; i < NUM_DIGITS - NUM_PAD_DIGITS; ++i)
-			in_block[i] = (in_block_offset + i < message_length) ?
-				message[in_block_offset + i] : 0xFF;
-		for (i = 0; i < NUM_PAD_DIGITS; ++i)
-			in_block[NUM_DIGITS - NUM_PAD_DIGITS + i] = PAD_DIGITS[i];
+		fill_block(block, message, message_length, in_block_offset);
+		bigint_from_bytes(in_block, block, KEY_SIZE_BYTES);
 
-		mod_exp(out_block, in_block, k->e, k->n);
+		mod_exp(out_block, in_block, e_bytes, sizeof(e_bytes), mod, EXP_WINDOW);
 
-		for (i = 0; i < NUM_DIGITS; ++i)
-			cyphertext[out_block_offset + i] = out_block[i];
+		for (i = 0; i < KEY_SIZE_BYTES; ++i)
+			cyphertext[out_block_offset + i] =
+				out_block[i / DIGIT_BYTES] >> (8 * (i % DIGIT_BYTES));
 
-		in_block_offset += NUM_DIGITS - NUM_PAD_DIGITS;
-		out_block_offset += NUM_DIGITS;
-		LOG("Blk offset after: %u\r\n", in_block_offset);
+		progress.enc_block++; // commit
+	}
+
+	*cyphertext_len = progress.enc_block * KEY_SIZE_BYTES;
+
+	print_bench("encrypt", EXP_WINDOW, progress.enc_block);
+}
 
+#if PRIVATE_KEY
+// Bytes of the decrypted block that differ from the offset-th block of
+// the message
+unsigned block_errors(const uint8_t *m, const uint8_t *message,
+		unsigned message_length, unsigned offset)
+{
+	uint8_t *block = work.block;
+	unsigned i, errors = 0;
+
+	fill_block(block, message, message_length, offset);
+	for (i = 0; i < KEY_SIZE_BYTES; ++i) {
+		if (m[i] != block[i])
+			errors++;
+	}
+	return errors;
+}
+
+void bigint_to_bytes(uint8_t *bytes, const unsigned *a)
+{
+	unsigned i;
+
+	for (i = 0; i < KEY_SIZE_BYTES; ++i)
+		bytes[i] = a[i / DIGIT_BYTES] >> (8 * (i % DIGIT_BYTES));
+}
+
+// Decrypts the cyphertext into DECRYPTED by CRT, resuming at
+// progress.dec_block and .stage; returns the bytes that do not match the
+// message
+unsigned decrypt(const uint8_t *cyphertext, unsigned cyphertext_len,
+		const uint8_t *message, unsigned message_length)
+{
+	unsigned offset, errors = 0;
+
+	bench_reset();
+
+	while ((offset = progress.dec_block * KEY_SIZE_BYTES) < cyphertext_len) {
+		bigint_from_bytes(work.in_block, cyphertext + offset, KEY_SIZE_BYTES);
+		if (progress.stage == 0) {
+			crt_exp(work.m1, work.in_block, privkey.dp, &crt.p, EXP_WINDOW);
+			progress.stage = 1; // commit
+		}
+		if (progress.stage == 1) {
+			crt_exp(work.m2, work.in_block, privkey.dq, &crt.q, EXP_WINDOW);
+			progress.stage = 2; // commit
+		}
+		crt_combine(work.out_block);
+		bigint_to_bytes(&DECRYPTED[offset], work.out_block);
+		progress.stage = 0;
+		progress.dec_block++; // commit
 	}
 
-	*cyphertext_len = out_block_offset;
+	for (offset = 0; offset < cyphertext_len; offset += KEY_SIZE_BYTES)
+		errors += block_errors(&DECRYPTED[offset], message, message_length,
+				offset / KEY_SIZE_BYTES * BLOCK_MSG_BYTES);
+
+	print_bench("decrypt, crt", EXP_WINDOW, cyphertext_len / KEY_SIZE_BYTES);
+	return errors;
 }
+
+#ifdef BENCH
+// The private operation on the first block, with and without the CRT and
+// the window, against square-and-multiply on the full d
+void bench_private(const uint8_t *cyphertext, const uint8_t *message,
+		unsigned message_length)
+{
+	unsigned windows[] = { 1, EXP_WINDOW };
+	uint8_t *m = work.m;
+	unsigned i;
+
+	bigint_from_bytes(work.in_block, cyphertext, KEY_SIZE_BYTES);
+	for (i = 0; i < sizeof(windows) / sizeof(windows[0]); ++i) {
+		bench_reset();
+		rsa_private(work.out_block, work.in_block, windows[i]);
+		print_bench("private", windows[i], 1);
+		bigint_to_bytes(m, work.out_block);
+		if (block_errors(m, message, message_length, 0))
+			PRINTF("bench: private: wrong result\r\n");
+
+		bench_reset();
+		rsa_private_crt(work.out_block, work.in_block, windows[i]);
+		print_bench("private, crt", windows[i], 1);
+		bigint_to_bytes(m, work.out_block);
+		if (block_errors(m, message, message_length, 0))
+			PRINTF("bench: private, crt: wrong result\r\n");
+	}
+}
+#endif // BENCH
+#endif // PRIVATE_KEY
+
 static void init_hw()
 {
 	msp_watchdog_disable();
@@ -534,6 +1407,7 @@ void init()
 	init_hw();
 
 	INIT_CONSOLE();
+	bench_init();
 
 	__enable_interrupt();
 #ifdef LOGIC
@@ -567,20 +1441,65 @@ int main()
 	// init() and restore_regs() should be called at the beginning of main.
 	// I could have made the compiler to do that, but was a bit lazy..
 	init();
+	TRACE_BOOT();
+	PROF_BOOT();
+	FAIL_BOOT();
+	RATCHET_ATOMIC_BOOT();
 	restore_regs();
+	TRACE_START();
 	unsigned message_length;
 
 	message_length = sizeof(PLAINTEXT) - 1; // exclude null byte
+	bigint_from_bytes(modulus.n, pubkey.n, KEY_SIZE_BYTES);
+	modulus.digits = NUM_DIGITS;
+#if REDUCE_METHOD == REDUCE_MONTGOMERY
+	mont_init(&modulus);
+#endif
+#if PRIVATE_KEY
+	crt_init();
+#endif
+	print_footprint();
 	//	uint8_t CYPHERTEXT[CYPHERTEXT_SIZE] = {0};
 	// 	unsigned CYPHERTEXT_LEN = 0;
 
 	while (1) {
+		TRACE_SITE(TRACE_SITE_ITER_BEGIN);
 #ifdef LOGIC
 		GPIO(PORT_AUX, OUT) |= BIT(PIN_AUX_1);
 		GPIO(PORT_AUX, OUT) &= ~BIT(PIN_AUX_1);
 #endif
 		PRINTF("start\r\n");
-		encrypt(CYPHERTEXT, &CYPHERTEXT_LEN, PLAINTEXT, message_length, &pubkey);
+		// A fresh start in the middle of a run resumes it at the first
+		// uncommitted block and exponentiation step
+		if (exp_state.begun == 0) {
+			fail_reset();
+			chkpt_reset();
+		}
+
+		encrypt(CYPHERTEXT, &CYPHERTEXT_LEN, PLAINTEXT, message_length,
+				&modulus, pubkey.e);
+#if PRIVATE_KEY
+		PRINTF("decrypt: %u bad bytes\r\n",
+				decrypt(CYPHERTEXT, CYPHERTEXT_LEN, PLAINTEXT, message_length));
+#endif
+
+		// Work lost to failures is the steps run more than once
+		PRINTF("rsa: %lu steps, %lu redone, %u failures, %lu ticks\r\n",
+				(unsigned long)exp_state.steps,
+				(unsigned long)(exp_state.begun - exp_state.steps),
+				fail_failures(), (unsigned long)fail_elapsed());
+#ifdef CHKPT_COUNT
+		PRINTF("rsa: %lu checkpoints, %lu/step\r\n",
+				(unsigned long)chkpt_count(),
+				(unsigned long)(chkpt_count() / exp_state.steps));
+#endif
+		progress.enc_block = 0;
+		progress.dec_block = 0;
+		exp_progress_reset();
+#if PRIVATE_KEY && defined(BENCH)
+		bench_private(CYPHERTEXT, PLAINTEXT, message_length);
+#endif
+		TRACE_SITE(TRACE_SITE_ITER_END);
 #ifdef LOGIC
 		GPIO(PORT_AUX3, OUT) |= BIT(PIN_AUX_3);
 		GPIO(PORT_AUX3, OUT) &= ~BIT(PIN_AUX_3);
@@ -0,0 +1,88 @@
+#ifndef PROF_H
+#define PROF_H
+
+// Statistical PC-sampling profiler.
+//
+// Build with PROF=1. Timer_A1 interrupts every PROF_PERIOD ticks of SMCLK/8;
+// the ISR bins the interrupted PC by function and bumps a 32-bit counter in
+// FRAM, so the histogram keeps accumulating across power failures.
+//
+// The PC -> function map comes from the symbol table of a previous build:
+//   cd ext/python_dissembler && python prof.py bins mem.src > ../../src/prof_bins.h
+// then rebuild (the map has a fixed size, so the layout does not move) and
+// report with prof.py report after dumping prof_hist.
+//
+// The ISR is written in assembly so that neither the Ratchet pass nor the
+// backend touches it: it must never checkpoint, and it must not depend on
+// the calling convention, which differs between the gcc and clang builds.
+
+#ifdef PROF
+
+#include <stdint.h>
+
+#include "prof_bins.h" // PROF_TEXT_START, PROF_MAP_INIT
+
+#ifndef PROF_PERIOD
+#define PROF_PERIOD 997 // ticks of SMCLK/8, odd to avoid locking to loops
+#endif
+
+#define PROF_SHIFT    4    // map granule: 16 bytes of .text
+#define PROF_MAP_LEN  1024 // granules, covers 16 KB of .text
+#define PROF_NUM_BINS 256  // bin 0 collects PCs outside the map
+
+// TIMER1_A0_VECTOR (0xFFE2)
+#define PROF_VECTOR_SECTION "__interrupt_vector_42"
+
+#define PROF_STR_INNER(x) #x
+#define PROF_STR(x) PROF_STR_INNER(x)
+
+__ro_nv const uint8_t prof_map[PROF_MAP_LEN] __attribute__((used)) =
+	PROF_MAP_INIT;
+__nv uint32_t prof_hist[PROF_NUM_BINS] __attribute__((used)) = {0};
+
+// On entry the CPU has pushed PC, then SR.
+__asm__(
+	"	.text\n"
+	"	.balign	2\n"
+	"prof_isr:\n"
+	"	push	r15\n"
+	"	mov	4(r1), r15\n"
+	"	sub	#" PROF_STR(PROF_TEXT_START) ", r15\n"
+	"	cmp	#(" PROF_STR(PROF_MAP_LEN) " << " PROF_STR(PROF_SHIFT) "), r15\n"
+	"	jhs	1f\n"
+	"	rra	r15\n" // offset < 0x8000, so arithmetic shift is fine
+	"	rra	r15\n"
+	"	rra	r15\n"
+	"	rra	r15\n"
+	"	mov.b	prof_map(r15), r15\n"
+	"	jmp	2f\n"
+	"1:\n"
+	"	clr	r15\n"
+	"2:\n"
+	"	rla	r15\n"
+	"	rla	r15\n"
+	"	add	#1, prof_hist(r15)\n"
+	"	adc	prof_hist+2(r15)\n"
+	"	pop	r15\n"
+	"	reti\n"
+	"	.section	" PROF_VECTOR_SECTION ",\"ax\",@progbits\n"
+	"	.word	prof_isr\n"
+	"	.text\n"
+);
+
+static inline void prof_boot()
+{
+	TA1CCR0 = PROF_PERIOD - 1;
+	TA1CCTL0 = CCIE;
+	TA1CTL = TASSEL__SMCLK | ID__8 | MC__UP | TACLR;
+}
+
+#define PROF_BOOT() prof_boot()
+
+#else // !PROF
+
+#define PROF_BOOT()
+
+#endif // PROF
+
+#endif
@@ -0,0 +1,5 @@
+// Generated by ext/python_dissembler/prof.py bins -- placeholder.
+// Build once with PROF=1, regenerate this file from that build's symbol
+// table, then rebuild. Until then every sample lands in bin 0.
+#define PROF_TEXT_START 0x4400
+#define PROF_MAP_INIT {0}
@@ -0,0 +1,79 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+// Persistent event trace for intermittent runs.
+//
+// Build with TRACE=1. Every event appends one 4-byte record (tag, Timer_A0
+// timestamp) to a ring buffer in FRAM that survives power failures. Dump
+// trace_log and decode it with ext/python_dissembler/trace_decode.py.
+// Without TRACE the macros compile to nothing.
+//
+// Timer_A0 is taken over for timestamps (SMCLK/8, continuous mode), so at
+// 8 MHz one tick is 1 us and the timestamp wraps every 65 ms.
+
+#ifdef TRACE
+
+#include <stdint.h>
+
+#ifndef TRACE_LEN
+#define TRACE_LEN 256 // records, must be a power of 2
+#endif
+
+// A tag is the event kind (top nibble) ORed with a site ID (low 12 bits).
+// Kind 0 is never written, so zeroed slots read as empty.
+#define TRACE_EV_BOOT   0x1000 // power-up, logged before restore_regs()
+#define TRACE_EV_START  0x2000 // restore_regs() returned: fresh start
+#define TRACE_EV_SITE   0x3000 // application site
+#define TRACE_EV_MASK   0xf000
+#define TRACE_SITE_MASK 0x0fff
+
+// Site IDs below this are reserved by the apps' main loops
+#define TRACE_SITE_ITER_BEGIN 0
+#define TRACE_SITE_ITER_END   1
+#define TRACE_SITE_USER       16
+
+typedef struct {
+	uint16_t tag;
+	uint16_t ts;
+} trace_rec_t;
+
+typedef struct {
+	uint16_t head; // next slot to write
+	trace_rec_t rec[TRACE_LEN];
+} trace_log_t;
+
+__nv trace_log_t trace_log = {0};
+
+// The log is accessed through a volatile pointer, like the GPIO registers in
+// init(), so that the Ratchet pass does not see the head update as a WAR.
+// An event that is re-executed after a restore is simply logged again,
+// which is exactly what we want to see.
+static inline void trace_append(uint16_t tag)
+{
+	volatile trace_log_t *log = &trace_log;
+	uint16_t head = log->head;
+
+	log->rec[head].tag = tag;
+	log->rec[head].ts = TA0R;
+	log->head = (head + 1) & (TRACE_LEN - 1);
+}
+
+static inline void trace_boot()
+{
+	TA0CTL = TASSEL__SMCLK | ID__8 | MC__CONTINUOUS | TACLR;
+	trace_append(TRACE_EV_BOOT);
+}
+
+#define TRACE_BOOT() trace_boot()
+#define TRACE_START() trace_append(TRACE_EV_START)
+#define TRACE_SITE(id) trace_append(TRACE_EV_SITE | (id))
+
+#else // !TRACE
+
+#define TRACE_BOOT()
+#define TRACE_START()
+#define TRACE_SITE(id)
+
+#endif // TRACE
+
+#endif